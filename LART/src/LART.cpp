@@ -3,11 +3,13 @@
 #include "LART.h"
 
 #include "bvh.h"
+#include "primitive_bvh.h"
 #include "camera.h"
 #include "hittable.h"
 #include "hittable_list.h"
 #include "material.h"
 #include "quad.h"
+#include "plane.h"
 #include "triangle.h"
 #include "sphere.h"
 #include "obj_loader.h"
@@ -33,7 +35,6 @@ void quads() {
 
     cam.aspect_ratio = 1.0;
     cam.image_width = 400;
-    cam.samples_per_pixel = 100;
     cam.max_depth = 50;
 
     cam.vfov = 80;
@@ -46,6 +47,41 @@ void quads() {
     cam.render(world);
 }
 
+void planes() {
+    hittable_list world;
+
+    auto floor_material = make_shared<lambertian>(color(0.8, 0.8, 0.8));
+    auto wall_material = make_shared<lambertian>(color(0.3, 0.3, 0.8));
+    auto light = make_shared<diffuse_light>(color(8, 8, 8));
+
+    // Two unbounded planes, which the BVH keeps out of its tree, around a row of spheres.
+    world.add(make_shared<plane>(point3(0, 0, 0), vec3(0, 1, 0), floor_material));
+    world.add(make_shared<plane>(point3(0, 0, -4), vec3(0, 0, 1), wall_material));
+    for (int i = -3; i <= 3; i++) {
+        auto albedo = color(0.5 + 0.07 * i, 0.4, 0.5 - 0.07 * i);
+        world.add(make_shared<sphere>(point3(1.2 * i, 0.5, -1), 0.5, make_shared<lambertian>(albedo)));
+    }
+    world.add(make_shared<quad>(point3(-2, 4, -2), vec3(4, 0, 0), vec3(0, 0, 2), light));
+
+    world = hittable_list(make_shared<bvh_node>(world));
+
+    camera cam;
+
+    cam.aspect_ratio = 16.0 / 9.0;
+    cam.image_width = 400;
+    cam.max_depth = 20;
+    cam.background = color(0.05, 0.05, 0.08);
+
+    cam.vfov = 40;
+    cam.lookfrom = point3(0, 2, 8);
+    cam.lookat = point3(0, 0.5, -1);
+    cam.vup = vec3(0, 1, 0);
+
+    cam.defocus_angle = 0;
+
+    cam.render(world);
+}
+
 void default_scene() {
     hittable_list world;
 
@@ -113,13 +149,12 @@ void default_scene() {
     auto material3 = make_shared<metal>(color(0.7, 0.6, 0.5), 0.0);
     world.add(make_shared<sphere>(point3(4, 1, 0), 1.0, material3));
 
-    world = hittable_list(make_shared<bvh_node>(world));
+    world = hittable_list(make_shared<primitive_bvh>(world));
 
     camera cam;
 
     /*cam.aspect_ratio = 16.0 / 9.0;
     cam.image_width = 960;
-    cam.samples_per_pixel = 1000;
     cam.max_depth = 10;
 
     cam.vfov = 90;
@@ -132,7 +167,6 @@ void default_scene() {
 
     cam.aspect_ratio = 16.0 / 9.0;
     cam.image_width = 3840;
-    cam.samples_per_pixel = 100;
     cam.max_depth = 50;
     cam.background = color(0.73, 0.73, 0.73);
 
@@ -176,7 +210,6 @@ void cornell_box() {
 
     cam.aspect_ratio = 1.0;
     cam.image_width = 2000;
-    cam.samples_per_pixel = 500;
     cam.max_depth = 50;
     cam.background = color(0, 0, 0);
 
@@ -213,8 +246,8 @@ void cornell_box_bunny() {
 
     //world.add(make_shared<triangle>(point3(200, 180, 100), point3(150, 150, 80), point3(250, 150, 80), glass));
 
-    shared_ptr<hittable> bunny = parseOBJ("./models/bunny_reduced_2x.obj", pink, 1600);
-    bunny = make_shared<rotate_y>(bunny, 180);
+    auto bunny_lod = parseOBJLOD("./models/bunny.obj", pink, 1600);
+    shared_ptr<hittable> bunny = make_shared<rotate_y>(bunny_lod, 180);
     bunny = make_shared<translate>(bunny, vec3(160, -60, 230));
     world.add(bunny);
 
@@ -228,17 +261,17 @@ void cornell_box_bunny() {
     box2 = make_shared<translate>(box2, vec3(130, 0, 65));
     world.add(box2);*/
 
-    world = hittable_list(make_shared<bvh_node>(world));
+    world = hittable_list(make_shared<primitive_bvh>(world));
 
     camera cam;
 
     cam.aspect_ratio = 1.0;
     cam.image_width = 4000;
-    cam.samples_per_pixel = 50;
     cam.max_samples_per_pixel = 600;
     cam.min_samples_per_pixel = 300;
     cam.max_depth = 8;
     cam.background = color(0.01, 0.01, 0.01);
+    cam.caustic_photons = 4000000; // The glass sphere's caustic comes from photons
 
     cam.vfov = 40;
     cam.lookfrom = point3(278, 278, -760);
@@ -247,6 +280,9 @@ void cornell_box_bunny() {
 
     cam.defocus_angle = 0;
 
+    // Level of detail from the bunny's size on screen.
+    bunny_lod->select_level(cam.projected_size(bunny->bounding_box()));
+
     cam.render(world);
 }
 
@@ -270,8 +306,8 @@ void cornell_box_bunny_demo() {
 
     world.add(make_shared<sphere>(point3(350, 40, 100), 40, glass));
 
-    shared_ptr<hittable> bunny = parseOBJ("./models/bunny_reduced_8x.obj", pink, 1600);
-    bunny = make_shared<rotate_y>(bunny, 180);
+    auto bunny_lod = parseOBJLOD("./models/bunny.obj", pink, 1600);
+    shared_ptr<hittable> bunny = make_shared<rotate_y>(bunny_lod, 180);
     bunny = make_shared<translate>(bunny, vec3(160, -60, 230));
     world.add(bunny);
 
@@ -280,17 +316,17 @@ void cornell_box_bunny_demo() {
     box1 = make_shared<translate>(box1, vec3(265, 0, 350));
     world.add(box1);
 
-    world = hittable_list(make_shared<bvh_node>(world));
+    world = hittable_list(make_shared<primitive_bvh>(world));
 
     camera cam;
 
     cam.aspect_ratio = 1.0;
     cam.image_width = 800;
-    cam.samples_per_pixel = 10;
     cam.max_samples_per_pixel = 80;
     cam.min_samples_per_pixel = 40;
     cam.max_depth = 5;
     cam.background = color(0.01, 0.01, 0.01);
+    cam.caustic_photons = 1000000; // The glass sphere's caustic comes from photons
 
     cam.vfov = 40;
     cam.lookfrom = point3(278, 278, -760);
@@ -299,6 +335,9 @@ void cornell_box_bunny_demo() {
 
     cam.defocus_angle = 0;
 
+    // Level of detail from the bunny's size on screen.
+    bunny_lod->select_level(cam.projected_size(bunny->bounding_box()));
+
     cam.render(world);
 }
 
@@ -310,6 +349,9 @@ int main() {
         case 2:
             cornell_box_bunny_demo();
             break;
+        case 3:
+            planes();
+            break;
         default:
             default_scene();
     }
@@ -2,7 +2,7 @@
 #define LART_H
 
 #include <cmath>
-#include <random>
+#include <cstdint>
 #include <iostream>
 #include <limits>
 #include <memory>
@@ -13,6 +13,15 @@
 using std::make_shared;
 using std::shared_ptr;
 
+// Scalar type of geometry and traversal (vec3, ray, interval, aabb). Building with
+// LART_SINGLE_PRECISION switches it to float; pixel sums stay in double either way.
+
+#ifdef LART_SINGLE_PRECISION
+using real = float;
+#else
+using real = double;
+#endif
+
 // Constants
 
 const double infinity = std::numeric_limits<double>::infinity();
@@ -24,10 +33,67 @@ inline double degrees_to_radians(double degrees) {
     return degrees * pi / 180.0;
 }
 
+inline uint64_t mix_bits(uint64_t v) {
+    // 64-bit xor-shift-multiply mixer (pbrt-v4's MixBits), good enough to decorrelate pixels and
+    // dimensions.
+    v ^= v >> 31;
+    v *= 0x7fb5d329728ea185ull;
+    v ^= v >> 27;
+    v *= 0x81dadef4bc2dd44dull;
+    v ^= v >> 33;
+    return v;
+}
+
+// PCG32 (O'Neill, "PCG: A Family of Simple Fast Space-Efficient Statistically Good Algorithms
+// for Random Number Generation", 2014): 16 bytes of state and a multiply per number.
+class pcg32 {
+  public:
+    pcg32() { set_sequence(0x853c49e6748fea9bull, 0xda3e39cb94b95bdbull); }
+
+    // Restarts stream `stream` from an initial state offset by `start`. Distinct streams are
+    // decorrelated, not disjoint: their outputs can still coincide.
+    void set_sequence(uint64_t start, uint64_t stream) {
+        state = 0;
+        increment = (stream << 1) | 1;
+        next_uint();
+        state += start;
+        next_uint();
+    }
+
+    uint32_t next_uint() {
+        auto old = state;
+        state = old * 0x5851f42d4c957f2dull + increment;
+        auto xorshifted = uint32_t(((old >> 18) ^ old) >> 27);
+        auto rotation = uint32_t(old >> 59);
+        return (xorshifted >> rotation) | (xorshifted << ((32 - rotation) & 31));
+    }
+
+    double next_double() {
+        // 32 random bits in [0,1), which is all the precision a sample needs.
+        return next_uint() * 0x1p-32;
+    }
+
+  private:
+    uint64_t state;
+    uint64_t increment;
+};
+
+inline pcg32& thread_random() {
+    // Each thread draws from its own generator, so results do not depend on scheduling as long
+    // as each piece of work seeds it with seed_random() first.
+    static thread_local pcg32 generator;
+    return generator;
+}
+
+inline void seed_random(uint64_t a, uint64_t b = 0, uint64_t c = 0) {
+    // Restarts the calling thread's random_double() sequence at one chosen by the keys, such as
+    // pixel, sample and frame.
+    thread_random().set_sequence(mix_bits(b ^ mix_bits(c)), mix_bits(a));
+}
+
 inline double random_double() {
-    static thread_local std::mt19937 generator{ std::random_device{}() };
-    static std::uniform_real_distribution<double> distribution(0.0, 1.0);
-    return distribution(generator);
+    // Returns a random real in [0,1).
+    return thread_random().next_double();
 }
 
 inline double random_double(double min, double max) {
@@ -1,18 +1,23 @@
 #ifndef AABB_H
 #define AABB_H
 
-class aabb {
+template <typename T>
+class basic_aabb {
   public:
+    using interval = basic_interval<T>;
+    using point3 = basic_vec3<T>;
+    using ray = basic_ray<T>;
+
     interval x, y, z;
 
-    aabb() {} // The default AABB is empty, since intervals are empty by default.
+    basic_aabb() {} // The default AABB is empty, since intervals are empty by default.
 
-    aabb(const interval& x, const interval& y, const interval& z)
+    basic_aabb(const interval& x, const interval& y, const interval& z)
         : x(x), y(y), z(z) {
         pad_to_minimums();
     }
 
-    aabb(const point3& a, const point3& b) {
+    basic_aabb(const point3& a, const point3& b) {
         // Treat the two points a and b as extrema for the bounding box, so we don't require a
         // particular minimum/maximum coordinate order.
 
@@ -23,7 +28,7 @@ class aabb {
         pad_to_minimums();
     }
 
-    aabb(const point3& a, const point3& b, const point3& c) {
+    basic_aabb(const point3& a, const point3& b, const point3& c) {
 
         x = interval(std::min({ a[0], b[0], c[0] }), std::max({ a[0], b[0], c[0] }));
         y = interval(std::min({ a[1], b[1], c[1] }), std::max({ a[1], b[1], c[1] }));
@@ -32,7 +37,7 @@ class aabb {
         pad_to_minimums();
     }
 
-    aabb(const aabb& box0, const aabb& box1) {
+    basic_aabb(const basic_aabb& box0, const basic_aabb& box1) {
         x = interval(box0.x, box1.x);
         y = interval(box0.y, box1.y);
         z = interval(box0.z, box1.z);
@@ -46,28 +51,32 @@ class aabb {
 
     bool hit(const ray& r, interval ray_t) const {
         const point3& ray_orig = r.origin();
-        const vec3& ray_dir = r.direction();
+        const vec3& ray_inv_dir = r.inv_direction();
 
+        // Slab test with the ray's precomputed 1/direction. Its sign says which side of each slab
+        // is entered first, so t0 <= t1 without a swap, and the selects below have no branches.
         for (int axis = 0; axis < 3; axis++) {
             const interval& ax = axis_interval(axis);
-            const double adinv = 1.0 / ray_dir[axis];
-
-            auto t0 = (ax.min - ray_orig[axis]) * adinv;
-            auto t1 = (ax.max - ray_orig[axis]) * adinv;
-
-            if (t0 < t1) {
-                if (t0 > ray_t.min) ray_t.min = t0;
-                if (t1 < ray_t.max) ray_t.max = t1;
-            }
-            else {
-                if (t1 > ray_t.min) ray_t.min = t1;
-                if (t0 < ray_t.max) ray_t.max = t0;
-            }
-
-            if (ray_t.max <= ray_t.min)
-                return false;
+            bool negative = r.negative(axis);
+
+            auto t0 = ((negative ? ax.max : ax.min) - ray_orig[axis]) * ray_inv_dir[axis];
+            auto t1 = ((negative ? ax.min : ax.max) - ray_orig[axis]) * ray_inv_dir[axis];
+
+            ray_t.min = t0 > ray_t.min ? t0 : ray_t.min;
+            ray_t.max = t1 < ray_t.max ? t1 : ray_t.max;
         }
-        return true;
+        return ray_t.min < ray_t.max;
+    }
+
+    T surface_area() const {
+        return 2 * (x.size() * y.size() + y.size() * z.size() + z.size() * x.size());
+    }
+
+    // Whether the box reaches past any finite scene, as an infinite plane's does. Compares with
+    // a large bound rather than std::isinf, which -ffast-math may assume false.
+    bool is_unbounded() const {
+        const T far = T(1e30);
+        return x.min < -far || x.max > far || y.min < -far || y.max > far || z.min < -far || z.max > far;
     }
 
     int longest_axis() const {
@@ -79,28 +88,37 @@ class aabb {
             return y.size() > z.size() ? 1 : 2;
     }
 
-    static const aabb empty, universe;
+    static const basic_aabb empty, universe;
 
   private:
 
     void pad_to_minimums() {
         // Adjust the AABB so that no side is narrower than some delta, padding if necessary.
 
-        double delta = 0.0001;
+        T delta = T(0.0001);
         if (x.size() < delta) x = x.expand(delta);
         if (y.size() < delta) y = y.expand(delta);
         if (z.size() < delta) z = z.expand(delta);
     }
 };
 
-const aabb aabb::empty = aabb(interval::empty, interval::empty, interval::empty);
-const aabb aabb::universe = aabb(interval::universe, interval::universe, interval::universe);
+template <typename T>
+const basic_aabb<T> basic_aabb<T>::empty = basic_aabb<T>(
+    basic_interval<T>::empty, basic_interval<T>::empty, basic_interval<T>::empty);
+
+template <typename T>
+const basic_aabb<T> basic_aabb<T>::universe = basic_aabb<T>(
+    basic_interval<T>::universe, basic_interval<T>::universe, basic_interval<T>::universe);
+
+using aabb = basic_aabb<real>;
 
-aabb operator+(const aabb& bbox, const vec3& offset) {
-    return aabb(bbox.x + offset.x(), bbox.y + offset.y(), bbox.z + offset.z());
+template <typename T>
+basic_aabb<T> operator+(const basic_aabb<T>& bbox, const basic_vec3<T>& offset) {
+    return basic_aabb<T>(bbox.x + offset.x(), bbox.y + offset.y(), bbox.z + offset.z());
 }
 
-aabb operator+(const vec3& offset, const aabb& bbox) {
+template <typename T>
+basic_aabb<T> operator+(const basic_vec3<T>& offset, const basic_aabb<T>& bbox) {
     return bbox + offset;
 }
 
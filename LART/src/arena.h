@@ -0,0 +1,130 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <utility>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+// Upstream for arena blocks: whole pages from the OS, optionally as huge pages. On Windows
+// large pages need the "Lock pages in memory" privilege; without it, or on other systems,
+// this falls back to normal pages.
+class page_resource : public std::pmr::memory_resource {
+  public:
+    explicit page_resource(bool huge_pages) : huge_pages(huge_pages) {}
+
+    size_t reserved_bytes() const { return reserved; }
+
+  private:
+    static constexpr size_t huge_page_size = size_t(2) << 20;
+
+    bool huge_pages;
+    size_t reserved = 0;
+
+    static size_t round_up(size_t bytes, size_t multiple) {
+        return (bytes + multiple - 1) / multiple * multiple;
+    }
+
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        if (!huge_pages) {
+            reserved += bytes;
+            return ::operator new(bytes, std::align_val_t(alignment));
+        }
+
+        bytes = round_up(bytes, huge_page_size);
+        void* p = nullptr;
+#if defined(_WIN32)
+        auto large = GetLargePageMinimum();
+        if (large > 0)
+            p = VirtualAlloc(nullptr, round_up(bytes, large),
+                             MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        if (!p)
+            p = VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#elif defined(__linux__)
+        p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            p = nullptr;
+        else
+            madvise(p, bytes, MADV_HUGEPAGE); // Transparent huge pages; only a hint
+#else
+        p = ::operator new(bytes, std::align_val_t(alignment), std::nothrow);
+#endif
+        if (!p)
+            throw std::bad_alloc();
+
+        reserved += bytes;
+        return p;
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+        if (!huge_pages) {
+            reserved -= bytes;
+            ::operator delete(p, bytes, std::align_val_t(alignment));
+            return;
+        }
+
+        bytes = round_up(bytes, huge_page_size);
+        reserved -= bytes;
+#if defined(_WIN32)
+        VirtualFree(p, 0, MEM_RELEASE);
+#elif defined(__linux__)
+        munmap(p, bytes);
+#else
+        ::operator delete(p, std::align_val_t(alignment));
+#endif
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+// Monotonic allocator for scene objects. Objects made here are packed into a few large
+// blocks instead of one heap allocation each; freeing them costs nothing, and the blocks go
+// back to the OS together when the arena is destroyed. Not thread-safe, and it must outlive
+// every object it made, so declare it before the scene that uses it.
+class arena {
+  public:
+    explicit arena(bool huge_pages = false, size_t initial_size = size_t(1) << 20)
+        : pages(huge_pages), resource(initial_size, &pages) {}
+
+    arena(const arena&) = delete;
+    arena& operator=(const arena&) = delete;
+
+    template <typename T, typename... Args>
+    shared_ptr<T> make(Args&&... args) {
+        // allocate_shared puts the object and its reference counts in one arena allocation.
+        return std::allocate_shared<T>(std::pmr::polymorphic_allocator<T>(&resource),
+                                       std::forward<Args>(args)...);
+    }
+
+    // Memory taken from the system so far.
+    size_t reserved_bytes() const { return pages.reserved_bytes(); }
+
+  private:
+    page_resource pages;
+    std::pmr::monotonic_buffer_resource resource;
+};
+
+// make_shared, or arena::make when an arena is given.
+template <typename T, typename... Args>
+shared_ptr<T> make_in(arena* a, Args&&... args) {
+    if (a)
+        return a->make<T>(std::forward<Args>(args)...);
+    return make_shared<T>(std::forward<Args>(args)...);
+}
+
+#endif
\ No newline at end of file
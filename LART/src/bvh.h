@@ -2,6 +2,7 @@
 #define BVH_H
 
 #include "aabb.h"
+#include "arena.h"
 #include "hittable.h"
 #include "hittable_list.h"
 
@@ -9,14 +10,114 @@
 
 class bvh_node : public hittable {
     public:
-        bvh_node(hittable_list list) : bvh_node(list.objects, 0, list.objects.size()) {
+        bvh_node(hittable_list list, arena* nodes = nullptr) {
             // There's a C++ subtlety here. This constructor (without span indices) creates an
             // implicit copy of the hittable list, which we will modify. The lifetime of the copied
             // list only extends until this constructor exits. That's OK, because we only need to
             // persist the resulting bounding volume hierarchy.
+            //
+            // Given an arena, the child nodes are allocated there instead of on the heap.
+
+            // Unbounded or huge objects (ground planes, sky domes) would inflate every node above
+            // them, so they are tested in a separate list before the tree instead.
+            auto large = split_large_objects(list.objects);
+            if (!large.empty()) {
+                large_objects = make_in<hittable_list>(nodes);
+                for (const auto& object : large)
+                    large_objects->add(object);
+            }
+
+            build(list.objects, 0, list.objects.size(), nodes);
+        }
+
+        bvh_node(
+            std::vector<shared_ptr<hittable>>& objects, size_t start, size_t end,
+            arena* nodes = nullptr
+        ) {
+            build(objects, start, end, nodes);
+        }
+
+        bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+            bool hit_large = large_objects && large_objects->hit(r, ray_t, rec);
+            if (hit_large)
+                ray_t.max = rec.t;
+
+            if (!bbox.hit(r, ray_t))
+                return hit_large;
+
+            bool hit_left = left->hit(r, ray_t, rec);
+            bool hit_right = right->hit(r, interval(ray_t.min, hit_left ? rec.t : ray_t.max), rec);
+
+            return hit_large || hit_left || hit_right;
+        }
+
+        aabb bounding_box() const override {
+            return large_objects ? aabb(bbox, large_objects->bounding_box()) : bbox;
+        }
+
+        void collect_lights(std::vector<const hittable*>& lights) const override {
+            if (large_objects)
+                large_objects->collect_lights(lights);
+            left->collect_lights(lights);
+            if (right != left)
+                right->collect_lights(lights);
+        }
+
+        // An object counts as large when its box is unbounded, or has more than this many times
+        // the surface area of the box around all remaining objects.
+        static constexpr double large_object_ratio = 2.0;
+
+        static std::vector<shared_ptr<hittable>> split_large_objects(
+            std::vector<shared_ptr<hittable>>& objects
+        ) {
+            // Removes the large objects from `objects` and returns them. Each pass compares every
+            // object against the union of all the others, so one huge object cannot hide another;
+            // passes repeat until nothing new stands out. At least one object stays behind.
+            std::vector<shared_ptr<hittable>> large;
+
+            while (objects.size() > 1) {
+                auto n = objects.size();
+                std::vector<aabb> suffix(n + 1, aabb::empty);
+                for (size_t i = n; i-- > 0;)
+                    suffix[i] = aabb(objects[i]->bounding_box(), suffix[i + 1]);
+
+                std::vector<bool> is_large(n, false);
+                size_t large_count = 0;
+                aabb prefix = aabb::empty;
+                for (size_t i = 0; i < n; i++) {
+                    auto box = objects[i]->bounding_box();
+                    auto others = aabb(prefix, suffix[i + 1]);
+                    is_large[i] = box.is_unbounded()
+                               || box.surface_area() > large_object_ratio * others.surface_area();
+                    large_count += is_large[i];
+                    prefix = aabb(prefix, box);
+                }
+
+                if (large_count == 0 || large_count == n)
+                    break;
+
+                size_t kept = 0;
+                for (size_t i = 0; i < n; i++) {
+                    if (is_large[i])
+                        large.push_back(objects[i]);
+                    else
+                        objects[kept++] = objects[i];
+                }
+                objects.resize(kept);
+            }
+
+            return large;
         }
 
-        bvh_node(std::vector<shared_ptr<hittable>>& objects, size_t start, size_t end) {
+    private:
+        shared_ptr<hittable> left;
+        shared_ptr<hittable> right;
+        shared_ptr<hittable_list> large_objects; // Only set on a root built from a list
+        aabb bbox;
+
+        void build(
+            std::vector<shared_ptr<hittable>>& objects, size_t start, size_t end, arena* nodes
+        ) {
             // Build the bounding box of the span of source objects.
             bbox = aabb::empty;
             for (size_t object_index = start; object_index < end; object_index++)
@@ -41,28 +142,11 @@ class bvh_node : public hittable {
                 std::sort(std::begin(objects) + start, std::begin(objects) + end, comparator);
 
                 auto mid = start + object_span / 2;
-                left = make_shared<bvh_node>(objects, start, mid);
-                right = make_shared<bvh_node>(objects, mid, end);
+                left = make_in<bvh_node>(nodes, objects, start, mid, nodes);
+                right = make_in<bvh_node>(nodes, objects, mid, end, nodes);
             }
         }
 
-        bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-            if (!bbox.hit(r, ray_t))
-                return false;
-
-            bool hit_left = left->hit(r, ray_t, rec);
-            bool hit_right = right->hit(r, interval(ray_t.min, hit_left ? rec.t : ray_t.max), rec);
-
-            return hit_left || hit_right;
-        }
-
-        aabb bounding_box() const override { return bbox; }
-
-    private:
-        shared_ptr<hittable> left;
-        shared_ptr<hittable> right;
-        aabb bbox;
-
         static bool box_compare(
             const shared_ptr<hittable> a, const shared_ptr<hittable> b, int axis_index
         ) {
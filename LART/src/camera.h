@@ -2,11 +2,18 @@
 #define CAMERA_H
 
 #include "hittable.h"
+#include "light_tree.h"
 #include "material.h"
+#include "photon_map.h"
+#include "radiance_cache.h"
+#include "restir.h"
+#include "sampler.h"
 
 #include "progress_bar.h"
 #include "denoiser.h"
 
+#include <algorithm>
+#include <functional>
 #include <vector>
 #include <omp.h>
 
@@ -17,12 +24,29 @@ class camera {
   public:
     double aspect_ratio = 1.0;  // Ratio of image width over height
     int    image_width = 100;  // Rendered image width in pixel count
-    int    samples_per_pixel = 10;   // Count of random samples for each pixel
     int    max_depth = 10;   // Maximum number of ray bounces into scene
+    int    roulette_depth = 3;   // Bounces before Russian roulette may end a path
+    int    split_factor = 1;     // Paths continued from each of a path's first ...
+    int    split_vertices = 1;   // ... this many non-specular hits
+    bool   radiance_caching = false; // Learn the light leaving diffuse surfaces between adaptive rounds ...
+    int    cache_after = 1;          // ... and end paths in it at diffuse hits after this many non-specular ones
+    double cache_cell_pixels = 8;    // Width of a cache cell, in pixels at its distance from the camera
+    int    cache_min_records = 16;   // Records a cell needs before paths end in it
+    bool   sample_lights = true; // Also sample emissive quads directly at non-specular surfaces
+    int    caustic_photons = 0;  // Photons traced from the lights for caustics, with sample_lights ...
+    double caustic_radius = 0;   // ... and gathered within this distance; 0 picks it from their spread
+    bool   restir = false;       // Direct light at first hits from reservoirs shared across pixels and frames
+    int    restir_candidates = 8;   // Light samples drawn per pixel and frame in ReSTIR mode
+    int    restir_neighbors = 4;    // Neighbouring reservoirs merged per pixel ...
+    int    restir_radius = 16;      // ... picked within this many pixels
     color  background;               // Scene background color
 
     int    max_samples_per_pixel = 100;
     int    min_samples_per_pixel = 10;
+    double sample_budget = 0;       // Average samples per pixel over the image; 0 for max_samples_per_pixel
+    double noise_threshold = 0.01;  // Relative standard error at which a tile stops sampling
+    bool   save_sample_heatmap = false; // Also write sample_heatmap.png, samples per pixel as colors
+    shared_ptr<sampler> pixel_sampler = make_shared<sobol_sampler>(); // Numbers for pixel, lens and bounce dimensions
 
     double vfov = 90;  // Vertical view angle (field of view)
     point3 lookfrom = point3(0, 0, 0);   // Point camera is looking from
@@ -32,9 +56,28 @@ class camera {
     double defocus_angle = 0;  // Variation angle of rays through each pixel
     double focus_dist = 10;    // Distance from camera lookfrom point to plane of perfect focus
 
+    // Approximate on-screen diameter, in pixels, of a world-space bounding box.
+    double projected_size(const aabb& box) const {
+        auto height = std::max(1, int(image_width / aspect_ratio));
+        auto center = point3(box.x.min + box.x.max, box.y.min + box.y.max, box.z.min + box.z.max) / 2;
+        auto radius = 0.5 * vec3(box.x.size(), box.y.size(), box.z.size()).length();
+        auto distance = (center - lookfrom).length();
+
+        if (distance <= radius)
+            return infinity;
+
+        return height * radius / (distance * std::tan(degrees_to_radians(vfov) / 2));
+    }
+
     void render(const hittable& world) {
         initialize();
 
+        std::vector<const hittable*> lights;
+        if (sample_lights)
+            world.collect_lights(lights);
+        light_sampler = light_tree(lights);
+        trace_caustic_photons(world, lights);
+
         int pixel_count = image_width * image_height;
         std::vector<unsigned char> image_color(pixel_count * 3);
         /*std::vector<unsigned char> image_albedo(pixel_count * 3);
@@ -44,68 +87,13 @@ class camera {
         std::vector<float> albedo_buffer(pixel_count * 3);
         std::vector<float> normal_buffer(pixel_count * 3);
 
-        progress_bar bar(image_height);
-
-        #pragma omp parallel for schedule(dynamic)
-        for (int j = 0; j < image_height; j++) {
-            for (int i = 0; i < image_width; i++) {
-                color pixel_color (0, 0, 0);
-                color pixel_albedo(0, 0, 0);
-                color pixel_normal(0, 0, 0);
-
-                for (int sample = 0; sample < samples_per_pixel; sample++) {
-                    ray r = get_ray(i, j);
-                    auto [albedo, normal] = ray_first_hit(r, world);
-                    pixel_albedo += albedo;
-                    pixel_normal += normal;
-                }
-
-                int sample_count = 0;
-
-                for (int sample = 0; sample < max_samples_per_pixel; sample++) {
-                    ray r = get_ray(i, j);
-                    color color_tmp = ray_color(r, max_depth, world);
-                    if (color_tmp[0] != 0 ||
-                        color_tmp[1] != 0 ||
-                        color_tmp[2] != 0) {
-                        pixel_color += color_tmp;
-                        if (++sample_count >= min_samples_per_pixel) {
-                            total_sample_count += sample + 1;
-                            break;
-                        }
-                    }
-                }
-
-                if (sample_count < min_samples_per_pixel) {
-                    if (sample_count == 0)
-                        sample_count = 1;
-                    total_sample_count += max_samples_per_pixel;
-                }
-
-                int idx = (j * image_width + i) * 3;
-
-                auto fill_buffer = [&](std::vector<float>& buffer, color pixel) {
-                    buffer[idx]     = pixel[0];
-                    buffer[idx + 1] = pixel[1];
-                    buffer[idx + 2] = pixel[2];
-                };
-
-                fill_buffer(color_buffer, 1.0 / sample_count * pixel_color);
-                fill_buffer(albedo_buffer, pixel_samples_scale * pixel_albedo);
-                fill_buffer(normal_buffer, pixel_samples_scale * pixel_normal);
-
-                /*write_color(1.0 / sample_count * pixel_color, image_color, idx);
-                write_color(pixel_samples_scale * pixel_albedo, image_albedo, idx);
-                write_color(pixel_samples_scale * (0.5 * pixel_normal + color(0.5, 0.5, 0.5)), image_normal, idx);*/
-            }
-
-            #pragma omp critical
-            {
-                bar.update(++progress);
-            }
-        }
-
-        bar.end(1.0 * total_sample_count / pixel_count);
+        long long ray_count = 0;
+        total_sample_count = 0;
+        cache = radiance_cache();
+        if (restir && !light_sampler.empty())
+            render_restir(world, color_buffer, albedo_buffer, normal_buffer, ray_count);
+        else
+            render_paths(world, color_buffer, albedo_buffer, normal_buffer, ray_count);
 
         /*write_png("image_color.png", image_color);
         write_png("image_albedo.png", image_albedo);
@@ -124,8 +112,9 @@ class camera {
     }
 
   private:
+    using color_sum = basic_vec3<double>; // Pixel sums stay in double in a float build
+
     int    image_height;         // Rendered image height
-    double pixel_samples_scale;  // Color scale factor for a sum of pixel samples
     point3 center;               // Camera center
     point3 pixel00_loc;          // Location of pixel 0, 0
     vec3   pixel_delta_u;        // Offset to pixel to the right
@@ -134,15 +123,635 @@ class camera {
     vec3   defocus_disk_u;       // Defocus disk horizontal radius
     vec3   defocus_disk_v;       // Defocus disk vertical radius
 
-    int    progress = 0;
+    light_tree light_sampler;  // Emitters sampled by next-event estimation
+    photon_map caustics;       // Light that reached diffuse surfaces through specular ones
+    mutable radiance_cache cache;  // Light leaving diffuse surfaces; paths record into it
+
+    // First hit of a pixel's camera path and its direct lighting reservoir, in ReSTIR mode.
+    struct restir_pixel {
+        ray r;
+        hit_record rec;
+        bool shade = false;  // Hit a non-specular surface, which takes direct light from reservoir
+        light_reservoir reservoir;
+    };
+
+    // Where a frame's pixel grid was, for finding a point's pixel in the previous frame.
+    struct frame_view {
+        point3 center;
+        point3 pixel00_loc;
+        vec3   pixel_delta_u;
+        vec3   pixel_delta_v;
+        int    width = 0;
+        int    height = 0;
+
+        bool project(const point3& p, int& i, int& j) const {
+            auto normal = cross(pixel_delta_u, pixel_delta_v);
+            auto d = p - center;
+            auto denominator = dot(d, normal);
+            if (std::fabs(denominator) < 1e-12)
+                return false;
+
+            auto t = dot(pixel00_loc - center, normal) / denominator;
+            if (t <= 0)
+                return false;
+
+            auto offset = center + t * d - pixel00_loc;
+            i = int(std::floor(dot(offset, pixel_delta_u) / pixel_delta_u.length_squared() + 0.5));
+            j = int(std::floor(dot(offset, pixel_delta_v) / pixel_delta_v.length_squared() + 0.5));
+            return i >= 0 && i < width && j >= 0 && j < height;
+        }
+    };
+
+    std::vector<restir_pixel> restir_history;  // Last frame's pixels, kept between render() calls
+    frame_view restir_history_view;
+
     long long total_sample_count = 0;
 
+    void trace_caustic_photons(const hittable& world, const std::vector<const hittable*>& lights) {
+        // Caustic photon map: caustic_photons photons leave the lights in proportion to their
+        // power, from a uniform point and in a cosine distributed direction on either side, and
+        // are stored where, after at least one specular bounce, they reach a non-specular
+        // surface. Camera paths then gather them there, and drop the lights their own specular
+        // bounces reach from such a surface.
+        caustics = photon_map();
+
+        std::vector<double> power_cdf;
+        double total_power = 0;
+        for (auto light : lights) {
+            total_power += light->emitted_power();
+            power_cdf.push_back(total_power);
+        }
+        if (caustic_photons <= 0 || light_sampler.empty() || total_power <= 0)
+            return;
+
+        // Photons are traced in fixed blocks, each with its own random sequence and buffer, so
+        // threads never share a buffer and the map does not depend on the thread count.
+        const int block_size = 4096;
+        int block_count = (caustic_photons + block_size - 1) / block_size;
+        std::vector<std::vector<photon>> blocks(block_count);
+
+        #pragma omp parallel
+        {
+            independent_sampler s;
+
+            #pragma omp for schedule(dynamic)
+            for (int b = 0; b < block_count; b++) {
+                seed_random(uint64_t(b), 0, 4);
+                int end = std::min(caustic_photons, (b + 1) * block_size);
+                for (int i = b * block_size; i < end; i++)
+                    trace_photon(world, lights, power_cdf, total_power, s, blocks[b]);
+            }
+        }
+
+        std::vector<photon> stored;
+        for (const auto& block : blocks)
+            stored.insert(stored.end(), block.begin(), block.end());
+        if (stored.empty())
+            return;
+
+        if (caustic_radius > 0) {
+            caustics = photon_map(stored, caustic_radius);
+            return;
+        }
+
+        // Automatic radius: first one that would hold about 20 photons were they spread evenly
+        // over the two longest sides of their bounds, then one that holds about 20 at the
+        // median density around the photons themselves, which is where the caustics gather.
+        aabb bounds = aabb::empty;
+        for (const auto& ph : stored)
+            bounds = aabb(bounds, aabb(ph.p, ph.p));
+        double sides[3] = { bounds.x.size(), bounds.y.size(), bounds.z.size() };
+        std::sort(sides, sides + 3);
+        auto area = std::fmax(sides[1] * sides[2], 1e-12);
+        auto radius = std::sqrt(20 * area / (pi * stored.size()));
+        caustics = photon_map(stored, radius);
+
+        std::vector<int> neighbours;
+        size_t step = std::max<size_t>(1, stored.size() / 1024);
+        for (size_t i = 0; i < stored.size(); i += step) {
+            int count = 0;
+            caustics.for_each_near(stored[i].p, [&](const photon&) { count++; });
+            neighbours.push_back(count);
+        }
+        auto median = neighbours.begin() + neighbours.size() / 2;
+        std::nth_element(neighbours.begin(), median, neighbours.end());
+        caustics = photon_map(stored, radius * std::sqrt(20.0 / *median));
+    }
+
+    void trace_photon(
+        const hittable& world, const std::vector<const hittable*>& lights,
+        const std::vector<double>& power_cdf, double total_power, sampler& s, std::vector<photon>& stored
+    ) const {
+        auto pick = std::upper_bound(power_cdf.begin(), power_cdf.end(), s.get_1d() * total_power);
+        const auto* light = lights[std::min(size_t(pick - power_cdf.begin()), lights.size() - 1)];
+
+        auto origin = point3(0, 0, 0) + light->random(point3(0, 0, 0), s.get_2d());
+        auto normal = light->emitting_normal();
+        if (s.get_1d() < 0.5)
+            normal = -normal;
+        auto direction = normal + sample_unit_vector(s.get_2d());
+        if (direction.near_zero())
+            direction = normal;
+
+        // Power of one photon, (2 pi area L) / (caustic_photons * light's share of the power);
+        // emitted_power() is 2 pi area times the mean of L.
+        auto L = light->emitted_radiance();
+        auto power = L * (total_power / (caustic_photons * (L.x() + L.y() + L.z()) / 3));
+
+        ray r(origin, direction);
+        bool specular = false;
+        for (int depth = 0; depth < max_depth; depth++) {
+            hit_record rec;
+            if (!world.hit(r, interval(0.001, infinity), rec))
+                return;
+            rec.resolve(r);
+
+            ray scattered;
+            color attenuation;
+            bool scatters = visit_material(*rec.mat, [&](const auto& mat) {
+                if (!mat.is_specular()) {
+                    if (specular)
+                        stored.push_back({ rec.p, unit_vector(r.direction()), power });
+                    return false;
+                }
+                return mat.scatter(r, rec, attenuation, scattered, s);
+            });
+            if (!scatters)
+                return;
+
+            specular = true;
+            power = power * attenuation;
+            r = ray(scattered.origin(), scattered.direction(), r.depth() + 1);
+        }
+    }
+
+    void render_paths(
+        const hittable& world, std::vector<float>& color_buffer, std::vector<float>& albedo_buffer,
+        std::vector<float>& normal_buffer, long long& ray_count
+    ) {
+        // Adaptive sampling by tiles. A pilot pass gives every pixel min_samples_per_pixel
+        // samples. Each later round estimates every tile's relative error and shares the rest of
+        // the image's sample_budget among the tiles above noise_threshold, in proportion to their
+        // noise, up to max_samples_per_pixel and what each needs to reach the threshold.
+        int pixel_count = image_width * image_height;
+        int tiles_x = (image_width + tile_size - 1) / tile_size;
+        int tiles_y = (image_height + tile_size - 1) / tile_size;
+        int tile_count = tiles_x * tiles_y;
+
+        auto average_budget = sample_budget > 0 ? std::fmin(sample_budget, double(max_samples_per_pixel))
+                                                : double(max_samples_per_pixel);
+        auto budget = average_budget * pixel_count;
+        long long spent = 0;
+        long long rays = 0;
+        progress_bar bar(1000);
+
+        std::vector<pixel_stats> stats(pixel_count);
+        std::vector<int> tile_samples(tile_count, 0);  // Samples per pixel so far, in each tile
+        std::vector<int> request(tile_count);          // Samples per pixel to add this round
+
+        // Pilot pass; the error estimate needs at least two samples, unless the cap allows one.
+        int pilot = std::min(std::max(2, min_samples_per_pixel), std::max(1, max_samples_per_pixel));
+        std::fill(request.begin(), request.end(), pilot);
+
+        if (radiance_caching)
+            cache = radiance_cache(omp_get_max_threads(), tile_count, cache_min_records);
+
+        while (true) {
+            spent += sample_tiles(world, stats, request, tiles_x, rays);
+
+            // What this round recorded joins the radiance cache.
+            if (radiance_caching)
+                cache.update();
+
+            for (int t = 0; t < tile_count; t++)
+                tile_samples[t] += request[t];
+            bar.update(std::max(1, int(1000 * std::fmin(1.0, spent / budget))));
+
+            // Tiles still above the threshold and below the per-pixel cap. Error falls as
+            // 1/sqrt(n), so a tile's per-sample deviation is its error times sqrt(n).
+            std::vector<std::pair<double, int>> noisy; // Error and tile
+            double deviation_sum = 0;
+            double noisy_spent = 0;
+            for (int t = 0; t < tile_count; t++) {
+                request[t] = 0;
+                int n = tile_samples[t];
+                auto error = tile_error(stats, t, tiles_x);
+                if (n >= max_samples_per_pixel || error <= noise_threshold)
+                    continue;
+
+                noisy.push_back({ error, t });
+                deviation_sum += error * std::sqrt(n) * tile_pixels(t, tiles_x);
+                noisy_spent += double(n) * tile_pixels(t, tiles_x);
+            }
+
+            auto remaining = budget - spent;
+            if (noisy.empty() || remaining <= 0)
+                break;
+
+            // Split what these tiles have had plus what is left in proportion to their deviations,
+            // which minimizes the summed squared error, but never beyond what reaches the
+            // threshold. Estimates from few samples are rough, so a round at most doubles a tile.
+            auto samples_per_deviation = (noisy_spent + remaining) / deviation_sum;
+            for (auto [error, t] : noisy) {
+                int n = tile_samples[t];
+                auto share = samples_per_deviation * error * std::sqrt(n);
+                auto needed = n * (error / noise_threshold) * (error / noise_threshold);
+                auto target = int(std::ceil(std::fmin(share, needed)));
+                request[t] = std::clamp(target - n, 0, std::min(n, max_samples_per_pixel - n));
+            }
+
+            // Rounding may overshoot the budget; the noisiest tiles are served first.
+            std::sort(noisy.begin(), noisy.end(), std::greater<>());
+            for (auto [error, t] : noisy) {
+                auto cost = double(request[t]) * tile_pixels(t, tiles_x);
+                if (cost <= remaining)
+                    remaining -= cost;
+                else
+                    request[t] = 0;
+            }
+
+            if (std::all_of(request.begin(), request.end(), [](int n) { return n == 0; }))
+                break;
+        }
+
+        for (int p = 0; p < pixel_count; p++) {
+            auto scale = 1.0 / stats[p].count;
+            for (int c = 0; c < 3; c++) {
+                color_buffer[p * 3 + c] = float(scale * stats[p].sum[c]);
+                albedo_buffer[p * 3 + c] = float(scale * stats[p].albedo_sum[c]);
+                normal_buffer[p * 3 + c] = float(scale * stats[p].normal_sum[c]);
+            }
+        }
+
+        ray_count += rays;
+        total_sample_count = spent;
+        bar.end(1.0 * total_sample_count / pixel_count, ray_count);
+
+        if (save_sample_heatmap)
+            write_sample_heatmap(stats);
+    }
+
+    // Albedo and normal at a path's first hit, for the denoiser.
+    struct surface_aovs {
+        color albedo;
+        vec3  normal;
+    };
+
+    // Running sums of one pixel's samples.
+    struct pixel_stats {
+        color_sum sum = color_sum(0, 0, 0);
+        color_sum albedo_sum = color_sum(0, 0, 0);
+        color_sum normal_sum = color_sum(0, 0, 0);
+        double luminance_sum = 0;
+        double luminance_squared_sum = 0;
+        int count = 0;
+
+        void add(const color& sample, const surface_aovs& aovs) {
+            auto y = luminance(sample);
+            sum += color_sum(sample);
+            albedo_sum += color_sum(aovs.albedo);
+            normal_sum += color_sum(aovs.normal);
+            luminance_sum += y;
+            luminance_squared_sum += y * y;
+            count++;
+        }
+
+        double relative_error() const {
+            // Standard error of the mean luminance over the mean. Dark pixels are measured
+            // against a floor instead, or their tiny means would soak up the budget.
+            if (count < 2)
+                return infinity;
+            auto mean = luminance_sum / count;
+            auto variance = std::fmax(0.0, (luminance_squared_sum - count * mean * mean) / (count - 1));
+            return std::sqrt(variance / count) / std::fmax(mean, 0.01);
+        }
+    };
+
+    static constexpr int tile_size = 8;
+
+    int tile_pixels(int t, int tiles_x) const {
+        int x0 = (t % tiles_x) * tile_size;
+        int y0 = (t / tiles_x) * tile_size;
+        return (std::min(x0 + tile_size, image_width) - x0) * (std::min(y0 + tile_size, image_height) - y0);
+    }
+
+    double tile_error(const std::vector<pixel_stats>& stats, int t, int tiles_x) const {
+        // Root mean square of the tile's pixel errors.
+        int x0 = (t % tiles_x) * tile_size;
+        int y0 = (t / tiles_x) * tile_size;
+        double sum = 0;
+        for (int j = y0; j < std::min(y0 + tile_size, image_height); j++) {
+            for (int i = x0; i < std::min(x0 + tile_size, image_width); i++) {
+                auto error = stats[j * image_width + i].relative_error();
+                sum += error * error;
+            }
+        }
+        return std::sqrt(sum / tile_pixels(t, tiles_x));
+    }
+
+    long long sample_tiles(
+        const hittable& world, std::vector<pixel_stats>& stats, const std::vector<int>& request,
+        int tiles_x, long long& ray_count
+    ) const {
+        // Adds request[t] samples to every pixel of tile t; returns the number of samples taken.
+        int tile_count = int(request.size());
+        long long samples = 0;
+        long long rays = 0;
+
+        #pragma omp parallel reduction(+ : samples, rays)
+        {
+            auto s = pixel_sampler->clone();
+
+            #pragma omp for schedule(dynamic)
+            for (int t = 0; t < tile_count; t++) {
+                if (request[t] <= 0)
+                    continue;
+
+                int x0 = (t % tiles_x) * tile_size;
+                int y0 = (t / tiles_x) * tile_size;
+                for (int j = y0; j < std::min(y0 + tile_size, image_height); j++) {
+                    for (int i = x0; i < std::min(x0 + tile_size, image_width); i++) {
+                        auto& pixel = stats[j * image_width + i];
+                        for (int sample = 0; sample < request[t]; sample++) {
+                            // Sample indices continue from earlier rounds, so the pixel's
+                            // samples stay one sequence. Seeding per sample keeps the image
+                            // independent of which thread renders which tile.
+                            s->start_pixel_sample(i, j, pixel.count);
+                            seed_random(j * image_width + i, pixel.count);
+                            surface_aovs aovs;
+                            auto radiance = ray_color(get_ray(i, j, *s), world, *s, rays, nullptr, &aovs);
+                            pixel.add(radiance, aovs);
+                        }
+                        samples += request[t];
+                    }
+                }
+
+                if (cache.recording())
+                    cache.end_tile(omp_get_thread_num(), t);
+            }
+        }
+
+        ray_count += rays;
+        return samples;
+    }
+
+    void write_sample_heatmap(const std::vector<pixel_stats>& stats) {
+        // Samples per pixel, from blue (fewest) to red (most).
+        auto [fewest, most] = std::minmax_element(stats.begin(), stats.end(), [](const auto& a, const auto& b) {
+            return a.count < b.count;
+        });
+        auto range = std::max(1, most->count - fewest->count);
+
+        std::vector<unsigned char> image(stats.size() * 3);
+        for (size_t p = 0; p < stats.size(); p++) {
+            auto t = double(stats[p].count - fewest->count) / range;
+            image[p * 3]     = (unsigned char)(255.999 * t);
+            image[p * 3 + 1] = (unsigned char)(255.999 * 0.2);
+            image[p * 3 + 2] = (unsigned char)(255.999 * (1 - t));
+        }
+
+        std::clog << "\nSamples per pixel: " << fewest->count << " to " << most->count;
+        write_png("sample_heatmap.png", image);
+    }
+
+    void render_restir(
+        const hittable& world, std::vector<float>& color_buffer, std::vector<float>& albedo_buffer,
+        std::vector<float>& normal_buffer, long long& ray_count
+    ) {
+        // Renders min_samples_per_pixel frames of one path per pixel. At each path's first hit,
+        // direct light comes from a reservoir that merges fresh light samples, the pixel's
+        // reservoir in the previous frame, and reservoirs of nearby pixels on similar surfaces.
+        // Pixels depend on each other, so there is no adaptive stopping here. Reuse across pixels
+        // ignores visibility at the neighbour, which darkens shadow edges slightly (the biased
+        // variant of the original paper).
+        int pixel_count = image_width * image_height;
+        int frames = std::max(1, min_samples_per_pixel);
+        long long rays = 0;
+        progress_bar bar(frames);
+
+        std::vector<restir_pixel> current(pixel_count);
+        std::vector<restir_pixel> reused(pixel_count);
+        std::vector<color_sum> pixel_color(pixel_count);
+        std::vector<color_sum> pixel_albedo(pixel_count);
+        std::vector<color_sum> pixel_normal(pixel_count);
+
+        if (restir_history_view.width != image_width || restir_history_view.height != image_height)
+            restir_history.clear();
+
+        for (int frame = 0; frame < frames; frame++) {
+            // Fresh candidates, then the same surface point's reservoir from the previous frame.
+            #pragma omp parallel reduction(+ : rays)
+            {
+                auto s = pixel_sampler->clone();
+
+                #pragma omp for schedule(dynamic)
+                for (int j = 0; j < image_height; j++) {
+                    for (int i = 0; i < image_width; i++) {
+                        auto& px = current[j * image_width + i];
+                        px = restir_pixel();
+                        s->start_pixel_sample(i, j, frame);
+                        seed_random(j * image_width + i, frame, 1);
+                        px.r = get_ray(i, j, *s);
+                        rays++;
+
+                        if (!world.hit(px.r, interval(0.001, infinity), px.rec))
+                            continue;
+
+                        px.rec.resolve(px.r);
+                        px.shade = visit_material(*px.rec.mat, [](const auto& mat) { return !mat.is_specular(); });
+                        if (!px.shade)
+                            continue;
+
+                        px.reservoir = initial_reservoir(px, world, rays);
+
+                        int pi, pj;
+                        if (!restir_history.empty() && restir_history_view.project(px.rec.p, pi, pj)) {
+                            const auto& previous = restir_history[pj * image_width + pi];
+                            if (similar_surfaces(px, previous)) {
+                                // Cap the history's weight so that old samples keep being replaced. Frames
+                                // are averaged here, so the cap is lower than the 20x usual in real time:
+                                // long-lived samples make frames correlated and the average noisier.
+                                auto history = previous.reservoir;
+                                history.count = std::min(history.count, 4 * px.reservoir.count);
+
+                                light_reservoir merged;
+                                merged.merge(px.reservoir, target_density(px, px.reservoir.sample));
+                                merged.merge(history, target_density(px, history.sample));
+                                merged.finalize(target_density(px, merged.sample));
+                                px.reservoir = merged;
+                            }
+                        }
+                    }
+                }
+            }
+
+            // Neighbouring pixels' reservoirs. Reads current, writes reused, so pixels can run in
+            // any order.
+            #pragma omp parallel for schedule(dynamic)
+            for (int j = 0; j < image_height; j++) {
+                for (int i = 0; i < image_width; i++) {
+                    const auto& px = current[j * image_width + i];
+                    auto& out = reused[j * image_width + i];
+                    out = px;
+                    if (!px.shade)
+                        continue;
+
+                    seed_random(j * image_width + i, frame, 2);
+                    light_reservoir merged;
+                    merged.merge(px.reservoir, target_density(px, px.reservoir.sample));
+
+                    for (int k = 0; k < restir_neighbors; k++) {
+                        auto offset = restir_radius * random_in_unit_disk();
+                        int ni = i + int(offset.x());
+                        int nj = j + int(offset.y());
+                        if (ni < 0 || ni >= image_width || nj < 0 || nj >= image_height || (ni == i && nj == j))
+                            continue;
+
+                        const auto& neighbor = current[nj * image_width + ni];
+                        if (similar_surfaces(px, neighbor))
+                            merged.merge(neighbor.reservoir, target_density(px, neighbor.reservoir.sample));
+                    }
+
+                    merged.finalize(target_density(px, merged.sample));
+                    out.reservoir = merged;
+                }
+            }
+
+            // Shade: follow each pixel's path, with the reservoir's light sample at its first hit.
+            #pragma omp parallel reduction(+ : rays)
+            {
+                auto s = pixel_sampler->clone();
+
+                #pragma omp for schedule(dynamic)
+                for (int j = 0; j < image_height; j++) {
+                    for (int i = 0; i < image_width; i++) {
+                        int idx = j * image_width + i;
+                        const auto& px = reused[idx];
+
+                        // Same sample as the first pass; redraw the camera dimensions px.r used so
+                        // the path continues with the next ones.
+                        s->start_pixel_sample(i, j, frame);
+                        seed_random(idx, frame, 3);
+                        get_ray(i, j, *s);
+
+                        surface_aovs aovs;
+                        pixel_color[idx] += color_sum(ray_color(px.r, world, *s, rays, &px.reservoir, &aovs));
+                        pixel_albedo[idx] += color_sum(aovs.albedo);
+                        pixel_normal[idx] += color_sum(aovs.normal);
+                    }
+                }
+            }
+
+            restir_history.swap(reused);
+            reused.resize(pixel_count);  // The history was empty before the first frame
+            restir_history_view = { center, pixel00_loc, pixel_delta_u, pixel_delta_v, image_width, image_height };
+            bar.update(frame + 1);
+        }
+
+        ray_count += rays;
+        total_sample_count += (long long)frames * pixel_count;
+        bar.end(1.0 * total_sample_count / pixel_count, ray_count);
+
+        for (int idx = 0; idx < pixel_count; idx++) {
+            for (int c = 0; c < 3; c++) {
+                color_buffer[idx * 3 + c] = float(pixel_color[idx][c] / frames);
+                albedo_buffer[idx * 3 + c] = float(pixel_albedo[idx][c] / frames);
+                normal_buffer[idx * 3 + c] = float(pixel_normal[idx][c] / frames);
+            }
+        }
+    }
+
+    light_reservoir initial_reservoir(const restir_pixel& px, const hittable& world, long long& ray_count) const {
+        // Resampled importance sampling: draw candidates from the light tree, keep one in
+        // proportion to its unshadowed contribution over its density, then test only that one.
+        light_reservoir reservoir;
+
+        for (int k = 0; k < restir_candidates; k++) {
+            light_sample candidate;
+            double pmf;
+            auto light = light_sampler.sample(px.rec.p, px.rec.normal, random_double(), pmf);
+            if (!light) {
+                reservoir.add(candidate, 0);
+                continue;
+            }
+
+            auto direction = light->random(px.rec.p, vec3(random_double(), random_double(), 0));
+            auto pdf = light->pdf_value(px.rec.p, direction) * pmf;
+
+            if (pdf <= 0 || !sample_emitter(*light, px.rec.p, direction, candidate)) {
+                reservoir.add(light_sample(), 0);
+                continue;
+            }
+
+            // Weigh by target over source density, both per unit area on the light; pdf is per
+            // solid angle at px.
+            auto geometry = geometry_term(px.rec.p, candidate);
+            auto weight = geometry > 0 ? target_density(px, candidate) / (pdf * geometry) : 0.0;
+            reservoir.add(candidate, weight);
+        }
+
+        reservoir.finalize(target_density(px, reservoir.sample));
+
+        // Occluded samples would only mislead neighbours and later frames.
+        if (!reservoir.empty() && !visible(px.rec.p, reservoir.sample, world, ray_count))
+            reservoir.W = 0;
+
+        return reservoir;
+    }
+
+    static bool sample_emitter(const hittable& light, const point3& origin, const vec3& direction, light_sample& s) {
+        // Fills s with the point of light that origin + direction reaches, and its emission.
+        ray r(origin, direction);
+        hit_record rec;
+        if (!light.hit(r, interval(0.001, infinity), rec))
+            return false;
+
+        rec.resolve(r);
+        s.light = &light;
+        s.p = origin + direction;
+        s.normal = light.emitting_normal();
+        s.emitted = visit_material(*rec.mat, [&](const auto& mat) { return mat.emitted(rec.u, rec.v, rec.p); });
+        return true;
+    }
+
+    static double geometry_term(const point3& p, const light_sample& s) {
+        // |cos| at the light over squared distance: converts solid angle at p to area on the light.
+        if (!s.light)
+            return 0;
+        auto d = s.p - p;
+        auto distance_squared = d.length_squared();
+        return std::fabs(dot(s.normal, d)) / (distance_squared * std::sqrt(distance_squared));
+    }
+
+    static double target_density(const restir_pixel& px, const light_sample& s) {
+        // Unshadowed contribution of s to px, per unit light area: what reservoirs resample by.
+        if (!s.light)
+            return 0;
+        auto direction = unit_vector(s.p - px.rec.p);
+        color f = visit_material(*px.rec.mat, [&](const auto& mat) { return mat.eval(px.r, px.rec, direction); });
+        return luminance(f * s.emitted) * geometry_term(px.rec.p, s);
+    }
+
+    static bool similar_surfaces(const restir_pixel& a, const restir_pixel& b) {
+        // Reservoirs are only shared between points with close normals and camera distances.
+        if (!b.shade)
+            return false;
+        auto depth_a = a.rec.t * a.r.direction().length();
+        auto depth_b = b.rec.t * b.r.direction().length();
+        return dot(a.rec.normal, b.rec.normal) > 0.9 && std::fabs(depth_a - depth_b) < 0.1 * depth_a;
+    }
+
+    bool visible(const point3& p, const light_sample& s, const hittable& world, long long& ray_count) const {
+        ray shadow_ray(p, s.p - p);
+        hit_record rec;
+        ray_count++;
+        return world.hit(shadow_ray, interval(0.001, infinity), rec) && rec.object == s.light;
+    }
+
     void initialize() {
         image_height = int(image_width / aspect_ratio);
         image_height = (image_height < 1) ? 1 : image_height;
 
-        pixel_samples_scale = 1.0 / samples_per_pixel;
-
         center = lookfrom;
 
         // Determine viewport dimensions.
@@ -174,64 +783,332 @@ class camera {
         defocus_disk_v = v * defocus_radius;
     }
 
-    ray get_ray(int i, int j) const {
+    ray get_ray(int i, int j, sampler& s) const {
         // Construct a camera ray originating from the defocus disk and directed at a randomly
     // sampled point around the pixel location i, j.
 
-        auto offset = sample_square();
+        auto offset = sample_square(s);
         auto pixel_sample = pixel00_loc
                             + ((i + offset.x()) * pixel_delta_u)
                             + ((j + offset.y()) * pixel_delta_v);
 
-        auto ray_origin = (defocus_angle <= 0) ? center : defocus_disk_sample();
+        auto lens = defocus_disk_sample(s);  // Drawn even without defocus, so later dimensions line up
+        auto ray_origin = (defocus_angle <= 0) ? center : lens;
         auto ray_direction = pixel_sample - ray_origin;
 
         return ray(ray_origin, ray_direction);
     }
 
-    vec3 sample_square() const {
-        // Returns the vector to a random point in the [-.5,-.5]-[+.5,+.5] unit square.
-        return vec3(random_double() - 0.5, random_double() - 0.5, 0);
+    vec3 sample_square(sampler& s) const {
+        // Returns the vector to a sampled point in the [-.5,-.5]-[+.5,+.5] unit square.
+        return s.get_2d() - vec3(0.5, 0.5, 0);
     }
 
-    point3 defocus_disk_sample() const {
-        // Returns a random point in the camera defocus disk.
-        auto p = random_in_unit_disk();
+    point3 defocus_disk_sample(sampler& s) const {
+        // Returns a sampled point in the camera defocus disk.
+        auto p = sample_unit_disk(s.get_2d());
         return center + (p[0] * defocus_disk_u) + (p[1] * defocus_disk_v);
     }
 
-    color ray_color(const ray& r, int depth, const hittable& world) const {
-        // If we've exceeded the ray bounce limit, no more light is gathered.
-        if (depth <= 0)
-            return color(0, 0, 0);
+    color ray_color(
+        const ray& r, const hittable& world, sampler& s, long long& ray_count,
+        const light_reservoir* reservoir = nullptr, surface_aovs* aovs = nullptr
+    ) const {
+        // Radiance along camera ray r. With a reservoir, the first hit takes its direct light
+        // from the reservoir's sample instead of sample_direct. With aovs, the first hit's albedo
+        // and normal are stored there.
+        return trace_path(r, path_state(), nullptr, world, s, ray_count, reservoir, aovs);
+    }
 
+    // Where a path stands before its next ray: what ray_color starts from, and what each branch
+    // of a split vertex continues from.
+    struct path_state {
+        color  throughput = color(1, 1, 1);  // Product of the attenuations so far
+        double scatter_pdf = 0;      // Density of the current ray's direction if the previous
+                                     // vertex also sampled a light, otherwise 0
+        vec3   scatter_normal;       // Surface normal at that vertex
+        bool   reservoir_lit = false; // The previous vertex took all its light-tree light from reservoir
+        int    depth = 0;            // Rays traced so far
+        int    diffuse_vertices = 0; // Non-specular hits so far
+        int    specular_run = -1;    // Specular hits since the last non-specular one; -1 before any
+    };
+
+    // A resolved hit shared by the branches of a split vertex.
+    struct split_hit {
         hit_record rec;
+        double emission_weight;
+    };
 
-        // If the ray hits nothing, return the background color.
-        if (!world.hit(r, interval(0.001, infinity), rec))
-            return background;
+    color trace_path(
+        ray r, const path_state& start, const split_hit* branch_hit, const hittable& world, sampler& s,
+        long long& ray_count, const light_reservoir* reservoir, surface_aovs* aovs
+    ) const {
+        // Follows one path for up to max_depth rays, carrying the throughput instead of
+        // recursing once per bounce. The first split_vertices non-specular hits instead start
+        // split_factor branches, each a path of its own, and average them, so one camera ray
+        // pays for several indirect samples. A branch starts at branch_hit,
+        // which r has already reached.
+        color radiance(0, 0, 0);
+        color throughput = start.throughput;
+        double scatter_pdf = start.scatter_pdf;
+        vec3 scatter_normal = start.scatter_normal;
+        bool reservoir_lit = start.reservoir_lit;
+        int diffuse_vertices = start.diffuse_vertices;
+        int specular_run = start.specular_run;
 
-        ray scattered;
-        color attenuation;
-        color color_from_emission = rec.mat->emitted(rec.u, rec.v, rec.p);
+        // Diffuse vertices whose outgoing light is recorded into the radiance cache at the end.
+        std::vector<cached_vertex> cached;
 
-        if (!rec.mat->scatter(r, rec, attenuation, scattered))
-            return color_from_emission;
+        for (int depth = start.depth; depth < max_depth; depth++) {
+            hit_record rec;
+            double emission_weight = 1;
 
-        color color_from_scatter = attenuation * ray_color(scattered, depth - 1, world);
+            if (branch_hit) {
+                rec = branch_hit->rec;
+                emission_weight = branch_hit->emission_weight;
+                branch_hit = nullptr;
+            }
+            else {
+                ray_count++;
 
-        return color_from_emission + color_from_scatter;
-    }
+                // If the ray hits nothing, add the background color.
+                if (!world.hit(r, interval(0.001, infinity), rec)) {
+                    radiance += throughput * background;
+                    if (aovs && depth == 0)
+                        *aovs = { background, vec3(0, 0, 1) };
+                    break;
+                }
 
-    // Get albedo and normal
-    std::pair<color, vec3> ray_first_hit(const ray& r, const hittable& world) const {
+                // When the previous vertex also sampled the lights, a light reached by its scattered
+                // ray is the other strategy's sample of the same light, and gets the matching weight.
+                // Lights seen through specular bounces from a diffuse hit are that hit's caustics,
+                // which the photon map gave it already.
+                if (reservoir_lit && is_light(rec.object))
+                    emission_weight = 0;
+                else if (specular_run > 0 && !caustics.empty() && is_light(rec.object))
+                    emission_weight = 0;
+                else if (scatter_pdf > 0 && is_light(rec.object))
+                    emission_weight = mis_weight(scatter_pdf, light_pdf(*rec.object, r, scatter_normal));
 
-        hit_record rec;
+                rec.resolve(r);
+
+                if (split_factor > 1 && diffuse_vertices < split_vertices
+                    && visit_material(*rec.mat, [](const auto& mat) { return !mat.is_specular(); }))
+                {
+                    // Branches average their radiance rather than carry a reduced throughput, which
+                    // would make Russian roulette end them early.
+                    split_hit hit = { rec, emission_weight };
+                    path_state branch = {
+                        throughput, scatter_pdf, scatter_normal, reservoir_lit, depth, diffuse_vertices,
+                        specular_run
+                    };
+                    color branch_sum(0, 0, 0);
+                    for (int b = 0; b < split_factor; b++)
+                        branch_sum += trace_path(r, branch, &hit, world, s, ray_count, reservoir, aovs);
+                    radiance += branch_sum / split_factor;
+                    break;
+                }
+            }
+
+            // Past cache_after non-specular hits, a diffuse hit in a cell the cache has learned
+            // ends the path with the light the cell says leaves it, direct light included.
+            uint64_t cache_key = 0;
+            bool diffuse = rec.mat->kind == material_kind::lambertian;
+            if (cache.recording() && diffuse) {
+                cache_key = cache_cell(rec);
+                color cell;
+                if (diffuse_vertices >= cache_after && cache.lookup(cache_key, cell)) {
+                    radiance += throughput * rec.mat->get_albedo() * cell;
+                    break;
+                }
+            }
+            auto radiance_before = radiance;
+
+            ray scattered;
+            color attenuation;
+            color color_from_emission;
+
+            bool scatters = visit_material(*rec.mat, [&](const auto& mat) {
+                if (aovs && depth == 0)
+                    *aovs = { mat.get_albedo(), rec.normal };
+
+                color_from_emission = mat.emitted(rec.u, rec.v, rec.p);
+
+                if (mat.is_specular()) {
+                    specular_run = specular_run < 0 ? -1 : specular_run + 1;
+                }
+                else {
+                    specular_run = 0;
+                    diffuse_vertices++;
+                }
+
+                if (!caustics.empty() && !mat.is_specular())
+                    radiance += throughput * gather_caustics(r, rec, mat);
 
-        if (world.hit(r, interval(0.001, infinity), rec)) {
-            return { rec.mat->get_albedo(), rec.normal };
+                // Light sampling comes first: it does not depend on the bounce, so it counts
+                // even where the bounce goes below the surface and the path ends.
+                reservoir_lit = false;
+                bool light_sampled = false;
+                if (reservoir && depth == 0 && !mat.is_specular()) {
+                    radiance += throughput * shade_reservoir(r, rec, mat, *reservoir, world, ray_count);
+                    reservoir_lit = true;
+                }
+                else if (!light_sampler.empty() && !mat.is_specular()) {
+                    radiance += throughput * sample_direct(r, rec, mat, world, s, ray_count);
+                    light_sampled = true;
+                }
+
+                if (!mat.scatter(r, rec, attenuation, scattered, s))
+                    return false;
+
+                // Combine with light sampling (multiple importance sampling) where the material
+                // has a density to weigh against.
+                scatter_pdf = light_sampled ? mat.scattering_pdf(r, rec, scattered.direction()) : 0;
+                if (light_sampled)
+                    scatter_normal = rec.normal;
+                return true;
+            });
+
+            radiance += throughput * color_from_emission * emission_weight;
+            if (cache.recording() && diffuse)
+                cached.push_back({ cache_key, throughput, radiance_before, rec.mat->get_albedo() });
+            if (!scatters)
+                break;
+
+            throughput = throughput * attenuation;
+
+            // Russian roulette: past roulette_depth, continue with a probability that follows
+            // the throughput, and divide by it when continuing so the estimate stays unbiased.
+            if (depth + 1 >= roulette_depth) {
+                auto max_throughput = std::fmax(throughput.x(), std::fmax(throughput.y(), throughput.z()));
+                auto p = std::fmin(max_throughput, 0.95);
+                if (s.get_1d() >= p)
+                    break;
+                throughput /= p;
+            }
+
+            r = ray(scattered.origin(), scattered.direction(), r.depth() + 1);
         }
-        return { background, vec3(0, 0, 1) };
+
+        // Light the rest of the path brought in, divided by the throughput and albedo it was
+        // scaled by, is an estimate of the light leaving each diffuse vertex towards the path.
+        if (!cached.empty()) {
+            int thread = omp_get_thread_num();
+            for (const auto& v : cached) {
+                color outgoing;
+                for (int c = 0; c < 3; c++) {
+                    auto scale = v.throughput[c] * v.albedo[c];
+                    outgoing[c] = scale > 0 ? (radiance[c] - v.radiance[c]) / scale : 0;
+                }
+                cache.record(thread, v.key, outgoing);
+            }
+        }
+
+        return radiance;
+    }
+
+    // A diffuse path vertex waiting to be recorded into the radiance cache.
+    struct cached_vertex {
+        uint64_t key;
+        color    throughput;  // Scale of the light leaving the vertex towards the path
+        color    radiance;    // Path's radiance before that light
+        color    albedo;
+    };
+
+    uint64_t cache_cell(const hit_record& rec) const {
+        // Cells are about cache_cell_pixels pixels wide where they are, rounded up to a power of
+        // two so that cells of one size line up.
+        auto pixel_width = (rec.p - center).length() * pixel_delta_u.length() / focus_dist;
+        auto size = std::exp2(std::ceil(std::log2(std::fmax(pixel_width * cache_cell_pixels, 1e-6))));
+        return radiance_cache::cell_key(rec.p, rec.normal, size);
+    }
+
+    template <typename Material>
+    color gather_caustics(const ray& r_in, const hit_record& rec, const Material& mat) const {
+        // Density estimate of the caustic light leaving rec along -r_in: the photons within the
+        // gather radius, each scattered by the material, spread over the disc the radius covers.
+        color sum(0, 0, 0);
+        caustics.for_each_near(rec.p, [&](const photon& ph) {
+            // Photons on the far side of a thin surface, or on another facing away, do not count.
+            auto cos_theta = -dot(ph.direction, rec.normal);
+            if (cos_theta > 0)
+                sum += ph.power * mat.eval(r_in, rec, -ph.direction) / cos_theta;
+        });
+
+        auto radius = caustics.gather_radius();
+        return sum / (pi * radius * radius);
+    }
+
+    bool is_light(const hittable* object) const {
+        return object && light_sampler.contains(object);
+    }
+
+    double light_pdf(const hittable& light, const ray& r, const vec3& normal) const {
+        // Density of light sampling at r's origin, on a surface with the given normal, producing
+        // r's direction: the light tree's chance of picking light times the light's own density.
+        return light.pdf_value(r.origin(), r.direction()) * light_sampler.pmf(r.origin(), normal, &light);
+    }
+
+    static double mis_weight(double pdf, double other_pdf) {
+        // Power heuristic with exponent 2.
+        return pdf * pdf / (pdf * pdf + other_pdf * other_pdf);
+    }
+
+    template <typename Material>
+    color sample_direct(
+        const ray& r_in, const hit_record& rec, const Material& mat, const hittable& world,
+        sampler& s, long long& ray_count
+    ) const {
+        // Light sampling half of the estimate: direct light from a point on one light picked by
+        // the light tree, found with a shadow ray and weighted against the material's own sampling.
+        double pmf;
+        auto picked = light_sampler.sample(rec.p, rec.normal, s.get_1d(), pmf);
+        if (!picked)
+            return color(0, 0, 0);
+        const auto& light = *picked;
+
+        ray shadow_ray(rec.p, light.random(rec.p, s.get_2d()), r_in.depth() + 1);
+        color f = mat.eval(r_in, rec, shadow_ray.direction());
+        if (f.near_zero())
+            return color(0, 0, 0);
+
+        hit_record light_rec;
+        ray_count++;
+
+        // The light is visible if it is the closest hit along the shadow ray.
+        if (!world.hit(shadow_ray, interval(0.001, infinity), light_rec))
+            return color(0, 0, 0);
+        if (light_rec.object != &light)
+            return color(0, 0, 0);
+
+        auto pdf = light.pdf_value(shadow_ray.origin(), shadow_ray.direction()) * pmf;
+        if (pdf <= 0)
+            return color(0, 0, 0);
+
+        light_rec.resolve(shadow_ray);
+        color emitted = visit_material(*light_rec.mat, [&](const auto& light_mat) {
+            return light_mat.emitted(light_rec.u, light_rec.v, light_rec.p);
+        });
+
+        auto weight = mis_weight(pdf, mat.scattering_pdf(r_in, rec, shadow_ray.direction()));
+        return f * emitted * (weight / pdf);
+    }
+
+    template <typename Material>
+    color shade_reservoir(
+        const ray& r_in, const hit_record& rec, const Material& mat, const light_reservoir& reservoir,
+        const hittable& world, long long& ray_count
+    ) const {
+        // Direct light from the reservoir's sample, weighted by its contribution weight W.
+        if (reservoir.empty())
+            return color(0, 0, 0);
+
+        const auto& s = reservoir.sample;
+        color f = mat.eval(r_in, rec, unit_vector(s.p - rec.p));
+        if (f.near_zero() || !visible(rec.p, s, world, ray_count))
+            return color(0, 0, 0);
+
+        return f * s.emitted * (geometry_term(rec.p, s) * reservoir.W);
     }
 
     void write_png(std::string filename, std::vector<unsigned char>& image) {
@@ -4,6 +4,8 @@
 #include "interval.h"
 #include "vec3.h"
 
+#include <vector>
+
 using color = vec3;
 
 inline double linear_to_gamma(double linear_component)
@@ -14,6 +16,11 @@ inline double linear_to_gamma(double linear_component)
     return 0;
 }
 
+// Relative luminance of a linear Rec. 709 color.
+inline double luminance(const color& c) {
+    return 0.2126 * c.x() + 0.7152 * c.y() + 0.0722 * c.z();
+}
+
 //void write_color(const color & pixel_color, unsigned char& rbyte, unsigned char& gbyte, unsigned char& bbyte) {
 void write_color(const color& pixel_color, std::vector<unsigned char>& image, int idx) {
     auto r = pixel_color.x();
@@ -3,18 +3,26 @@
 
 #include "aabb.h"
 
+#include <vector>
+
 class material;
+class hittable;
 
 class hit_record {
   public:
     point3 p;
     vec3 normal;
-    shared_ptr<material> mat;
-    double t;
-    double u;
-    double v;
+    const material* mat = nullptr; // Not owning; the hit primitive keeps its material alive
+    real t;
+    real u;
+    real v;
     bool front_face;
 
+    // Primitive whose closest hit still lacks p, normal, front_face and mat. During traversal
+    // primitives only record t, u, v and themselves here; resolve() computes the rest once.
+    const hittable* object = nullptr;
+    uint32_t primitive = 0; // Index within object, for objects holding many primitives
+
     void set_face_normal(const ray& r, const vec3& outward_normal) {
         // Sets the hit record normal vector.
         // NOTE: the parameter `outward_normal` is assumed to have unit length.
@@ -22,6 +30,8 @@ class hit_record {
         front_face = dot(r.direction(), outward_normal) < 0;
         normal = front_face ? outward_normal : -outward_normal;
     }
+
+    void resolve(const ray& r);
 };
 
 class hittable {
@@ -30,25 +40,73 @@ class hittable {
 
     virtual bool hit(const ray& r, interval ray_t, hit_record& rec) const = 0;
 
+    // Fills in the attributes of a hit this object deferred in hit(). Objects that complete the
+    // record inside hit() must leave rec.object null instead, and need not override this.
+    virtual void set_hit_attributes(const ray& /*r*/, hit_record& /*rec*/) const {}
+
     virtual aabb bounding_box() const = 0;
+
+    // Appends the emissive primitives below this object that the camera samples directly.
+    // Instances (translate, rotate_y) do not forward this, as their lights live in another frame
+    // (see warn_unsampled_lights).
+    virtual void collect_lights(std::vector<const hittable*>& /*lights*/) const {}
+
+    // Light sampling, for objects that collect_lights() reports: a direction from origin toward
+    // a point on the object chosen by the 2D sample u = (u1, u2, 0), and the solid angle
+    // density of picking a given direction.
+    virtual double pdf_value(const point3& /*origin*/, const vec3& /*direction*/) const { return 0.0; }
+
+    virtual vec3 random(const point3& /*origin*/, const vec3& /*u*/) const { return vec3(1, 0, 0); }
+
+    // Total emitted power and the normal of the emitting surface (both of its sides emit), which
+    // the light tree uses to guess how much a light contributes at a point.
+    virtual double emitted_power() const { return 0.0; }
+
+    virtual vec3 emitting_normal() const { return vec3(0, 0, 0); }
+
+    // Radiance given off everywhere on the emitting surface, for tracing photons from it.
+    virtual color emitted_radiance() const { return color(0, 0, 0); }
 };
 
+inline void hit_record::resolve(const ray& r) {
+    if (!object)
+        return;
+
+    auto deferred = object;
+    object = nullptr;
+    deferred->set_hit_attributes(r, *this);
+}
+
+// Instances resolve their hits in hit(), so the camera cannot tell the lights below them from
+// other surfaces and does not sample them. Such lights still shine on what scattered rays
+// bring back from them, only with more noise; this says so rather than leave them out quietly.
+inline void warn_unsampled_lights(const hittable& object, const char* instance) {
+    std::vector<const hittable*> lights;
+    object.collect_lights(lights);
+    if (!lights.empty())
+        std::cerr << "Lights inside " << instance << " are not sampled directly : "
+                  << lights.size() << std::endl;
+}
+
 class translate : public hittable {
   public:
     translate(shared_ptr<hittable> object, const vec3& offset)
         : object(object), offset(offset)
     {
         bbox = object->bounding_box() + offset;
+        warn_unsampled_lights(*object, "translate");
     }
 
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
         // Move the ray backwards by the offset
-        ray offset_r(r.origin() - offset, r.direction());
+        ray offset_r(r.origin() - offset, r.direction(), r.depth());
 
         // Determine whether an intersection exists along the offset ray (and if so, where)
         if (!object->hit(offset_r, ray_t, rec))
             return false;
 
+        rec.resolve(offset_r);
+
         // Move the intersection point forwards by the offset
         rec.p += offset;
 
@@ -66,6 +124,8 @@ class translate : public hittable {
 class rotate_y : public hittable {
   public:
     rotate_y(shared_ptr<hittable> object, double angle) : object(object) {
+        warn_unsampled_lights(*object, "rotate_y");
+
         auto radians = degrees_to_radians(angle);
         sin_theta = std::sin(radians);
         cos_theta = std::cos(radians);
@@ -113,13 +173,15 @@ class rotate_y : public hittable {
             (sin_theta * r.direction().x()) + (cos_theta * r.direction().z())
         );
 
-        ray rotated_r(origin, direction);
+        ray rotated_r(origin, direction, r.depth());
 
         // Determine whether an intersection exists in object space (and if so, where).
 
         if (!object->hit(rotated_r, ray_t, rec))
             return false;
 
+        rec.resolve(rotated_r);
+
         // Transform the intersection from object space back to world space.
 
         rec.p = point3(
@@ -141,8 +203,8 @@ class rotate_y : public hittable {
 
   private:
     shared_ptr<hittable> object;
-    double sin_theta;
-    double cos_theta;
+    real sin_theta;
+    real cos_theta;
     aabb bbox;
 };
 
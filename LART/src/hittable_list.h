@@ -21,15 +21,14 @@ public:
     }
 
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-        hit_record temp_rec;
         bool hit_anything = false;
         auto closest_so_far = ray_t.max;
 
+        // Objects only write to rec when they report a closer hit, so no temporary is needed.
         for (const auto& object : objects) {
-            if (object->hit(r, interval(ray_t.min, closest_so_far), temp_rec)) {
+            if (object->hit(r, interval(ray_t.min, closest_so_far), rec)) {
                 hit_anything = true;
-                closest_so_far = temp_rec.t;
-                rec = temp_rec;
+                closest_so_far = rec.t;
             }
         }
 
@@ -38,6 +37,11 @@ public:
 
     aabb bounding_box() const override { return bbox; }
 
+    void collect_lights(std::vector<const hittable*>& lights) const override {
+        for (const auto& object : objects)
+            object->collect_lights(lights);
+    }
+
     private:
         aabb bbox;
 };
@@ -0,0 +1,260 @@
+#ifndef LIGHT_TREE_H
+#define LIGHT_TREE_H
+
+#include "hittable.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Hierarchy over the scene's emitters for picking one light per shading point, in the style of
+// pbrt-v4's BVHLightSampler. Each node bounds its lights in space and in emitting direction and
+// sums their power; sampling walks down from the root, choosing a child in proportion to a
+// conservative estimate of how much it can contribute at the point. Lights that face away or
+// are far away are then rarely chosen, whatever their count.
+//
+// All emitters here light both sides of their surface, so node cones bound normals up to sign.
+class light_tree {
+  public:
+    light_tree() {}
+
+    explicit light_tree(const std::vector<const hittable*>& emitters) {
+        std::vector<build_ref> refs;
+        for (auto light : emitters) {
+            auto power = light->emitted_power();
+            if (power > 0)
+                refs.push_back({ light, light_bounds(light->bounding_box(), light->emitting_normal(), power) });
+        }
+
+        if (!refs.empty())
+            build(refs, 0, refs.size(), 0, 0);
+    }
+
+    bool empty() const { return nodes.empty(); }
+
+    bool contains(const hittable* object) const { return trails.count(object) > 0; }
+
+    // Chooses a light for the point p on a surface with normal n using the sample u in [0,1),
+    // and sets pmf to the probability of that choice. Returns nullptr when no light can reach p.
+    const hittable* sample(const point3& p, const vec3& n, double u, double& pmf) const {
+        pmf = 0;
+        if (nodes.empty() || nodes[0].bounds.importance(p, n) <= 0)
+            return nullptr;
+
+        double probability = 1;
+        uint32_t current = 0;
+
+        while (!nodes[current].leaf) {
+            double first = nodes[current + 1].bounds.importance(p, n);
+            double second = nodes[nodes[current].index].bounds.importance(p, n);
+            if (first <= 0 && second <= 0)
+                return nullptr;
+
+            // Pick a child with u, then stretch the part of [0,1) that picked it back to [0,1).
+            double p_first = first / (first + second);
+            if (u < p_first) {
+                probability *= p_first;
+                current = current + 1;
+                u = std::fmin(u / p_first, 0x1.fffffffffffffp-1);
+            }
+            else {
+                probability *= 1 - p_first;
+                current = nodes[current].index;
+                u = std::fmin((u - p_first) / (1 - p_first), 0x1.fffffffffffffp-1);
+            }
+        }
+
+        pmf = probability;
+        return lights[nodes[current].index];
+    }
+
+    // Probability that sample(p, n) chooses light; 0 for objects not in the tree.
+    double pmf(const point3& p, const vec3& n, const hittable* light) const {
+        auto it = trails.find(light);
+        if (it == trails.end() || nodes[0].bounds.importance(p, n) <= 0)
+            return 0;
+
+        uint64_t trail = it->second;
+        double probability = 1;
+        uint32_t current = 0;
+
+        while (!nodes[current].leaf) {
+            double first = nodes[current + 1].bounds.importance(p, n);
+            double second = nodes[nodes[current].index].bounds.importance(p, n);
+            if (first <= 0 && second <= 0)
+                return 0;
+
+            if (trail & 1) {
+                probability *= second / (first + second);
+                current = nodes[current].index;
+            }
+            else {
+                probability *= first / (first + second);
+                current = current + 1;
+            }
+            trail >>= 1;
+        }
+
+        return probability;
+    }
+
+  private:
+    class light_bounds {
+      public:
+        aabb box;
+        vec3 axis;             // Normals lie within the cone around +-axis ...
+        double cos_theta = 1;  // ... of this half angle
+        double power = 0;
+
+        light_bounds() {}
+
+        light_bounds(const aabb& box, const vec3& normal, double power)
+            : box(box), axis(normal), power(power) {}
+
+        light_bounds(const light_bounds& a, const light_bounds& b)
+            : box(a.box, b.box), power(a.power + b.power)
+        {
+            // Two-sided emitters: flip b's cone to a's side so similar planes merge tightly.
+            auto b_axis = dot(a.axis, b.axis) < 0 ? -b.axis : b.axis;
+            merge_cones(a.axis, a.cos_theta, b_axis, b.cos_theta);
+        }
+
+        double importance(const point3& p, const vec3& n) const {
+            // Upper bound on the power arriving at p, following pbrt-v4's LightBounds. The angle
+            // between the emitting normals and the direction to p is reduced by the cone and by
+            // the angle the box subtends from p; emission falls off as its cosine.
+            auto center = point3(box.x.min + box.x.max, box.y.min + box.y.max, box.z.min + box.z.max) / 2;
+            auto half_diagonal_squared = vec3(box.x.size(), box.y.size(), box.z.size()).length_squared() / 4;
+            auto distance_squared = std::fmax((p - center).length_squared(), half_diagonal_squared);
+
+            // Angle subtended by the box's bounding sphere.
+            double cos_b = -1, sin_b = 0;
+            auto to_center_squared = (p - center).length_squared();
+            if (to_center_squared > half_diagonal_squared) {
+                double sin2 = half_diagonal_squared / to_center_squared;
+                sin_b = std::sqrt(sin2);
+                cos_b = std::sqrt(1 - sin2);
+            }
+
+            auto w = unit_vector(p - center);
+            double cos_w = std::fabs(dot(axis, w));
+            double sin_w = std::sqrt(std::fmax(0.0, 1 - cos_w * cos_w));
+            double sin_o = std::sqrt(std::fmax(0.0, 1 - cos_theta * cos_theta));
+
+            // Reduce the angle by the cone, then by the subtended angle.
+            double cos_x = cos_sub_clamped(sin_w, cos_w, sin_o, cos_theta);
+            double sin_x = sin_sub_clamped(sin_w, cos_w, sin_o, cos_theta);
+            double cos_p = cos_sub_clamped(sin_x, cos_x, sin_b, cos_b);
+            if (cos_p <= 0)
+                return 0;
+
+            double result = power * cos_p / distance_squared;
+
+            // The receiving surface's cosine, bounded the same way.
+            double cos_i = std::fabs(dot(w, n));
+            double sin_i = std::sqrt(std::fmax(0.0, 1 - cos_i * cos_i));
+            result *= cos_sub_clamped(sin_i, cos_i, sin_b, cos_b);
+
+            return std::fmax(result, 0.0);
+        }
+
+      private:
+        // cos(max(0, a - b)) and sin(max(0, a - b)) from the sines and cosines of a and b.
+        static double cos_sub_clamped(double sin_a, double cos_a, double sin_b, double cos_b) {
+            return cos_a > cos_b ? 1 : cos_a * cos_b + sin_a * sin_b;
+        }
+
+        static double sin_sub_clamped(double sin_a, double cos_a, double sin_b, double cos_b) {
+            return cos_a > cos_b ? 0 : sin_a * cos_b - cos_a * sin_b;
+        }
+
+        void merge_cones(const vec3& a, double cos_a, const vec3& b, double cos_b) {
+            // Smallest cone holding both cones (pbrt-v4's DirectionCone Union).
+            double theta_a = std::acos(std::clamp(cos_a, -1.0, 1.0));
+            double theta_b = std::acos(std::clamp(cos_b, -1.0, 1.0));
+            double theta_d = std::acos(std::clamp(double(dot(a, b)), -1.0, 1.0));
+
+            if (std::fmin(theta_d + theta_b, pi) <= theta_a) {
+                axis = a;
+                cos_theta = cos_a;
+                return;
+            }
+            if (std::fmin(theta_d + theta_a, pi) <= theta_b) {
+                axis = b;
+                cos_theta = cos_b;
+                return;
+            }
+
+            double theta_o = (theta_a + theta_d + theta_b) / 2;
+            auto k = cross(a, b);
+            if (theta_o >= pi || k.near_zero()) {
+                axis = a;
+                cos_theta = -1;
+                return;
+            }
+
+            // Rotate a towards b by theta_o - theta_a, about their common normal.
+            double theta_r = theta_o - theta_a;
+            k = unit_vector(k);
+            axis = a * std::cos(theta_r) + cross(k, a) * std::sin(theta_r);
+            cos_theta = std::cos(theta_o);
+        }
+    };
+
+    struct node {
+        light_bounds bounds;
+        uint32_t index = 0;  // Light for leaves, second child for interior nodes
+        bool leaf = false;
+    };
+
+    struct build_ref {
+        const hittable* light;
+        light_bounds bounds;
+    };
+
+    std::vector<node> nodes;
+    std::vector<const hittable*> lights;
+    std::unordered_map<const hittable*, uint64_t> trails; // Bit d set: second child at depth d
+
+    uint32_t build(std::vector<build_ref>& refs, size_t start, size_t end, uint64_t trail, int depth) {
+        auto index = uint32_t(nodes.size());
+        nodes.emplace_back();
+
+        // Median splits keep the depth near log2 of the light count, well inside the 64-bit trails.
+        if (end - start == 1) {
+            nodes[index].leaf = true;
+            nodes[index].index = uint32_t(lights.size());
+            nodes[index].bounds = refs[start].bounds;
+            lights.push_back(refs[start].light);
+            trails[refs[start].light] = trail;
+            return index;
+        }
+
+        // Median split along the longest axis of the centroids.
+        aabb centroids = aabb::empty;
+        for (size_t i = start; i < end; i++) {
+            const auto& box = refs[i].bounds.box;
+            auto c = point3(box.x.min + box.x.max, box.y.min + box.y.max, box.z.min + box.z.max) / 2;
+            centroids = aabb(centroids, aabb(c, c));
+        }
+        int axis = centroids.longest_axis();
+
+        auto mid = start + (end - start) / 2;
+        std::nth_element(refs.begin() + start, refs.begin() + mid, refs.begin() + end,
+                         [axis](const build_ref& a, const build_ref& b) {
+                             const auto& ia = a.bounds.box.axis_interval(axis);
+                             const auto& ib = b.bounds.box.axis_interval(axis);
+                             return ia.min + ia.max < ib.min + ib.max;
+                         });
+
+        auto first = build(refs, start, mid, trail, depth + 1);
+        auto second = build(refs, mid, end, trail | (uint64_t(1) << depth), depth + 1);
+
+        nodes[index].index = second;
+        nodes[index].bounds = light_bounds(nodes[first].bounds, nodes[second].bounds);
+        return index;
+    }
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,154 @@
+#ifndef LOD_MESH_H
+#define LOD_MESH_H
+
+#include "arena.h"
+#include "bvh.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "mesh.h"
+#include "triangle.h"
+
+// The levels of detail of one model: a triangle mesh and its simplified versions. A level is
+// turned into triangles and a BVH while some instance uses it; the others stay indexed meshes.
+// Shared by the lod_mesh instances of the model.
+class lod_chain {
+  public:
+    lod_chain(std::vector<triangle_mesh> levels, shared_ptr<material> mat)
+        : levels(std::move(levels)), mat(mat), arenas(this->levels.size()), accels(this->levels.size()),
+          users(this->levels.size(), 0)
+    {
+        bbox = aabb::empty;
+        for (const auto& level : this->levels)
+            bbox = aabb(bbox, level.bounding_box());
+    }
+
+    int level_count() const { return int(levels.size()); }
+    size_t triangle_count(int l) const { return levels[l].faces.size(); }
+    const aabb& bounding_box() const { return bbox; }
+    bool emissive() const { return mat->kind == material_kind::diffuse_light; }
+
+    // Level l as triangles under a BVH, built when its first user acquires it and freed when
+    // its last user releases it. Not thread-safe; call before rendering.
+    const hittable* acquire(int l) {
+        if (users[l]++ == 0) {
+            arenas[l] = std::make_unique<arena>();
+            accels[l] = build_level(l, *arenas[l]);
+        }
+        return accels[l].get();
+    }
+
+    void release(int l) {
+        if (--users[l] == 0) {
+            accels[l].reset();
+            arenas[l].reset();
+        }
+    }
+
+  private:
+    std::vector<triangle_mesh> levels;
+    shared_ptr<material> mat;
+    std::vector<std::unique_ptr<arena>> arenas; // Triangles and BVH nodes of each built level
+    std::vector<shared_ptr<hittable>> accels;
+    std::vector<int> users;                     // Instances that may hit each level
+    aabb bbox;
+
+    shared_ptr<hittable> build_level(int l, arena& storage) const {
+        hittable_list triangles;
+        const auto& mesh = levels[l];
+        triangles.objects.reserve(mesh.faces.size());
+        for (const auto& f : mesh.faces)
+            triangles.add(storage.make<triangle>(
+                mesh.vertices[f[0]], mesh.vertices[f[1]], mesh.vertices[f[2]], mat));
+
+        if (triangles.objects.empty())
+            return storage.make<hittable_list>();
+
+        return storage.make<bvh_node>(triangles, &storage);
+    }
+};
+
+// One instance of a model with levels of detail, drawn at the level it selected. Instances of
+// the same lod_chain share its built levels but each keeps its own level; levels no instance
+// can hit any more are freed.
+class lod_mesh : public hittable {
+  public:
+    double triangles_per_pixel = 0.25; // Triangle budget per covered pixel for select_level()
+
+    explicit lod_mesh(shared_ptr<lod_chain> chain) : chain(chain) { set_level(0); }
+
+    lod_mesh(std::vector<triangle_mesh> levels, shared_ptr<material> mat)
+        : lod_mesh(make_shared<lod_chain>(std::move(levels), mat)) {}
+
+    lod_mesh(const lod_mesh&) = delete;
+    lod_mesh& operator=(const lod_mesh&) = delete;
+
+    ~lod_mesh() {
+        for (int i = 0; i < level_count(); i++)
+            if (accels[i])
+                chain->release(i);
+    }
+
+    // The model's levels, for creating further instances of it.
+    shared_ptr<lod_chain> shared_chain() const { return chain; }
+
+    int level_count() const { return chain->level_count(); }
+    int current_level() const { return level; }
+    size_t triangle_count(int l) const { return chain->triangle_count(l); }
+
+    // Uses level l for primary rays. With depth_step > 0, rays that have already scattered
+    // drop one further level every depth_step bounces. A coarser level is a different surface,
+    // so rays leaving the finer one may start inside or behind it and leak light, and shadow
+    // rays still test level l; keep depth_step at 0 unless the levels are close. Emissive
+    // meshes ignore depth_step, so that every ray sees the level their lights are sampled on.
+    // Not thread-safe; call before rendering.
+    void set_level(int l, int depth_step = 0) {
+        level = std::clamp(l, 0, level_count() - 1);
+        this->depth_step = chain->emissive() ? 0 : depth_step;
+
+        // New levels are acquired before the old ones are released, so levels in both stay built.
+        int coarsest = (this->depth_step > 0) ? level_count() - 1 : level;
+        std::vector<const hittable*> used(level_count(), nullptr);
+        for (int i = level; i <= coarsest; i++)
+            used[i] = chain->acquire(i);
+        for (int i = 0; i < int(accels.size()); i++)
+            if (accels[i])
+                chain->release(i);
+        accels = std::move(used);
+    }
+
+    // Picks the finest level whose triangle count fits the budget for an instance that
+    // covers screen_pixels across (see camera::projected_size).
+    void select_level(double screen_pixels, int depth_step = 0) {
+        auto covered_pixels = 0.25 * pi * screen_pixels * screen_pixels;
+        auto budget = triangles_per_pixel * covered_pixels;
+
+        int l = 0;
+        while (l + 1 < level_count() && double(triangle_count(l)) > budget)
+            l++;
+
+        set_level(l, depth_step);
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        int l = level;
+        if (depth_step > 0)
+            l = std::min(level + r.depth() / depth_step, level_count() - 1);
+
+        return accels[l]->hit(r, ray_t, rec);
+    }
+
+    aabb bounding_box() const override { return chain->bounding_box(); }
+
+    // The triangles of the selected level; select it before the camera builds its light tree.
+    void collect_lights(std::vector<const hittable*>& lights) const override {
+        accels[level]->collect_lights(lights);
+    }
+
+  private:
+    shared_ptr<lod_chain> chain;
+    std::vector<const hittable*> accels; // Built levels this instance may hit, by level
+    int level = 0;
+    int depth_step = 0;
+};
+
+#endif
\ No newline at end of file
@@ -2,33 +2,60 @@
 #define MATERIAL_H
 
 #include "hittable.h"
+#include "sampler.h"
+
+// Built-in material types, so hot code can reach them without a virtual call (visit_material).
+enum class material_kind : uint8_t { lambertian, metal, dielectric, diffuse_light, custom };
 
 class material {
     public:
+        // Materials defined outside this file are custom and go through the virtual functions.
+        material(material_kind kind = material_kind::custom) : kind(kind) {}
         virtual ~material() = default;
 
-        virtual color emitted(double u, double v, const point3& p) const {
+        const material_kind kind;
+
+        virtual color emitted(double /*u*/, double /*v*/, const point3& /*p*/) const {
             return color(0, 0, 0);
         }
 
+        // Numbers for the choice of direction come from s.
         virtual bool scatter(
-            const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered
+            const ray& /*r_in*/, const hit_record& /*rec*/, color& /*attenuation*/, ray& /*scattered*/,
+            sampler& /*s*/
         ) const {
             return false;
         }
 
+        // Sample/evaluate/pdf view of scattering, used to weigh scatter() against light sampling.
+        // scattering_pdf() is the solid angle density with which scatter() picks `direction`,
+        // and eval() the fraction of light from `direction` scattered along -r_in, cosine
+        // included, so that eval / scattering_pdf is the attenuation scatter() reports.
+        // Specular materials pick from a discrete set of directions and have neither.
+        virtual bool is_specular() const { return true; }
+
+        virtual double scattering_pdf(
+            const ray& /*r_in*/, const hit_record& /*rec*/, const vec3& /*direction*/
+        ) const {
+            return 0;
+        }
+
+        virtual color eval(const ray& /*r_in*/, const hit_record& /*rec*/, const vec3& /*direction*/) const {
+            return color(0, 0, 0);
+        }
+
         virtual color get_albedo() const {
             return color(0, 0, 0);
         }
 };
 
-class lambertian : public material {
+class lambertian final : public material {
     public:
-        lambertian(const color& albedo) : albedo(albedo) {}
+        lambertian(const color& albedo) : material(material_kind::lambertian), albedo(albedo) {}
 
-        bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered)
+        bool scatter(const ray& /*r_in*/, const hit_record& rec, color& attenuation, ray& scattered, sampler& s)
             const override {
-                auto scatter_direction = rec.normal + random_unit_vector();
+                auto scatter_direction = rec.normal + sample_unit_vector(s.get_2d());
 
                 // Catch degenerate scatter direction
                 if (scatter_direction.near_zero())
@@ -39,25 +66,74 @@ class lambertian : public material {
                 return true;
         }
 
+        bool is_specular() const override { return false; }
+
+        double scattering_pdf(const ray& /*r_in*/, const hit_record& rec, const vec3& direction)
+            const override {
+                // normal + a uniform unit vector is cosine distributed about the normal.
+                auto cos_theta = dot(rec.normal, unit_vector(direction));
+                return cos_theta < 0 ? 0 : cos_theta / pi;
+        }
+
+        color eval(const ray& r_in, const hit_record& rec, const vec3& direction) const override {
+            return albedo * scattering_pdf(r_in, rec, direction);
+        }
+
         color get_albedo() const override { return albedo; }
 
     private:
         color albedo;
 };
 
-class metal : public material {
+class metal final : public material {
     public:
-        metal(const color& albedo, double fuzz) : albedo(albedo), fuzz(fuzz < 1 ? fuzz : 1) {}
+        metal(const color& albedo, double fuzz)
+            : material(material_kind::metal), albedo(albedo), fuzz(fuzz < 1 ? fuzz : 1) {}
 
-        bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered)
+        bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered, sampler& s)
             const override {
                 vec3 reflected = reflect(r_in.direction(), rec.normal);
-                reflected = unit_vector(reflected) + (fuzz * random_unit_vector());
+                reflected = unit_vector(reflected) + (fuzz * sample_unit_vector(s.get_2d()));
                 scattered = ray(rec.p, reflected);
                 attenuation = albedo;
                 return (dot(scattered.direction(), rec.normal) > 0);
         }
 
+        bool is_specular() const override { return fuzz <= 0; }
+
+        double scattering_pdf(const ray& r_in, const hit_record& rec, const vec3& direction)
+            const override {
+                // scatter() aims at a uniform point on the sphere of radius fuzz around the unit
+                // mirror direction m. A unit direction w meets that sphere at the roots of
+                // t^2 - 2 t (w.m) + 1 - fuzz^2 = 0, and each root t > 0 adds
+                // t^2 / (cos * 4 pi fuzz^2), where cos = sqrt(disc) / fuzz is the angle to the
+                // sphere normal there.
+                if (fuzz <= 0)
+                    return 0;
+
+                auto w = unit_vector(direction);
+                auto m = unit_vector(reflect(r_in.direction(), rec.normal));
+                double b = dot(w, m);
+                double disc = b * b - (1 - fuzz * fuzz);
+                if (disc <= 0)
+                    return 0;
+
+                double root = std::sqrt(disc);
+                double sum = 0;
+                for (double t : { b - root, b + root })
+                    if (t > 0)
+                        sum += t * t;
+
+                return sum / (4 * pi * fuzz * root);
+        }
+
+        color eval(const ray& r_in, const hit_record& rec, const vec3& direction) const override {
+            // Directions below the surface are absorbed (scatter() returns false for them).
+            if (dot(direction, rec.normal) <= 0)
+                return color(0, 0, 0);
+            return albedo * scattering_pdf(r_in, rec, direction);
+        }
+
         color get_albedo() const override { return albedo; }
 
     private:
@@ -65,11 +141,12 @@ class metal : public material {
         double fuzz;
 };
 
-class dielectric : public material {
+class dielectric final : public material {
 public:
-    dielectric(double refraction_index) : refraction_index(refraction_index) {}
+    dielectric(double refraction_index)
+        : material(material_kind::dielectric), refraction_index(refraction_index) {}
 
-    bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered)
+    bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered, sampler& s)
         const override {
         attenuation = color(1.0, 1.0, 1.0);
         double ri = rec.front_face ? (1.0 / refraction_index) : refraction_index;
@@ -81,7 +158,7 @@ public:
         bool cannot_refract = ri * sin_theta > 1.0;
         vec3 direction;
 
-        if (cannot_refract || reflectance(cos_theta, ri) > random_double())
+        if (cannot_refract || reflectance(cos_theta, ri) > s.get_1d())
             direction = reflect(unit_direction, rec.normal);
         else
             direction = refract(unit_direction, rec.normal, ri);
@@ -105,11 +182,11 @@ private:
     }
 };
 
-class diffuse_light : public material {
+class diffuse_light final : public material {
     public:
-        diffuse_light(const color& emit) : emit(emit) {}
+        diffuse_light(const color& emit) : material(material_kind::diffuse_light), emit(emit) {}
 
-        color emitted(double u, double v, const point3& p) const override {
+        color emitted(double /*u*/, double /*v*/, const point3& /*p*/) const override {
             return emit;
         }
 
@@ -119,4 +196,17 @@ class diffuse_light : public material {
         color emit;
 };
 
+// Calls f with m cast to its concrete type. The built-in classes are final, so the calls f
+// makes on them are resolved at compile time and the only branch left is this switch.
+template <typename F>
+decltype(auto) visit_material(const material& m, F&& f) {
+    switch (m.kind) {
+        case material_kind::lambertian:    return f(static_cast<const lambertian&>(m));
+        case material_kind::metal:         return f(static_cast<const metal&>(m));
+        case material_kind::dielectric:    return f(static_cast<const dielectric&>(m));
+        case material_kind::diffuse_light: return f(static_cast<const diffuse_light&>(m));
+        default:                           return f(m);
+    }
+}
+
 #endif
\ No newline at end of file
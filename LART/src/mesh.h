@@ -0,0 +1,251 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include "aabb.h"
+
+#include <algorithm>
+#include <array>
+#include <queue>
+#include <vector>
+
+// Indexed triangle mesh, the shared form of loaded geometry before it becomes primitives.
+class triangle_mesh {
+  public:
+    std::vector<point3> vertices;
+    std::vector<std::array<int, 3>> faces;
+
+    aabb bounding_box() const {
+        aabb bbox = aabb::empty;
+        for (const auto& f : faces)
+            bbox = aabb(bbox, aabb(vertices[f[0]], vertices[f[1]], vertices[f[2]]));
+        return bbox;
+    }
+};
+
+// Symmetric 4x4 error quadric (Garland & Heckbert), stored as its upper triangle.
+class quadric {
+  public:
+    double a[10] = {};
+
+    quadric() {}
+
+    quadric(const vec3& n, double d, double weight) {
+        // Quadric of the plane dot(n, p) + d = 0, scaled by weight.
+        double p[4] = { n.x(), n.y(), n.z(), d };
+        int k = 0;
+        for (int i = 0; i < 4; i++)
+            for (int j = i; j < 4; j++)
+                a[k++] = weight * p[i] * p[j];
+    }
+
+    quadric& operator+=(const quadric& q) {
+        for (int i = 0; i < 10; i++)
+            a[i] += q.a[i];
+        return *this;
+    }
+
+    double error(const point3& p) const {
+        auto x = p.x(), y = p.y(), z = p.z();
+        return a[0] * x * x + 2 * a[1] * x * y + 2 * a[2] * x * z + 2 * a[3] * x
+             + a[4] * y * y + 2 * a[5] * y * z + 2 * a[6] * y
+             + a[7] * z * z + 2 * a[8] * z
+             + a[9];
+    }
+
+    bool minimizer(point3& p) const {
+        // Solve the 3x3 system for the point of least error; fails when it is ill-conditioned.
+        double m00 = a[0], m01 = a[1], m02 = a[2];
+        double m11 = a[4], m12 = a[5], m22 = a[7];
+        double bx = -a[3], by = -a[6], bz = -a[8];
+
+        double c00 = m11 * m22 - m12 * m12;
+        double c01 = m02 * m12 - m01 * m22;
+        double c02 = m01 * m12 - m02 * m11;
+        double det = m00 * c00 + m01 * c01 + m02 * c02;
+
+        double scale = std::fabs(m00) + std::fabs(m11) + std::fabs(m22);
+        if (std::fabs(det) <= 1e-12 * scale * scale * scale)
+            return false;
+
+        double c11 = m00 * m22 - m02 * m02;
+        double c12 = m01 * m02 - m00 * m12;
+        double c22 = m00 * m11 - m01 * m01;
+
+        p = point3(c00 * bx + c01 * by + c02 * bz,
+                   c01 * bx + c11 * by + c12 * bz,
+                   c02 * bx + c12 * by + c22 * bz) / det;
+        return true;
+    }
+};
+
+// Reduces the mesh to at most target_faces triangles by quadric error edge collapses.
+inline triangle_mesh simplify(const triangle_mesh& mesh, size_t target_faces) {
+    auto verts = mesh.vertices;
+    auto faces = mesh.faces;
+
+    std::vector<quadric> quadrics(verts.size());
+    std::vector<std::vector<int>> vertex_faces(verts.size());
+    std::vector<int> version(verts.size(), 0);
+    std::vector<bool> vertex_removed(verts.size(), false);
+    std::vector<bool> face_removed(faces.size(), false);
+
+    for (size_t f = 0; f < faces.size(); f++) {
+        const auto& a = verts[faces[f][0]];
+        auto n = cross(verts[faces[f][1]] - a, verts[faces[f][2]] - a);
+        auto area2 = n.length();
+        for (int k = 0; k < 3; k++)
+            vertex_faces[faces[f][k]].push_back(int(f));
+        if (area2 <= 0)
+            continue;
+        n /= area2;
+        quadric q(n, -dot(n, a), 0.5 * area2);
+        for (int k = 0; k < 3; k++)
+            quadrics[faces[f][k]] += q;
+    }
+
+    struct collapse {
+        double cost;
+        int v0, v1;
+        int version0, version1;
+        point3 target;
+
+        bool operator>(const collapse& other) const { return cost > other.cost; }
+    };
+
+    auto evaluate = [&](int v0, int v1) {
+        quadric q = quadrics[v0];
+        q += quadrics[v1];
+
+        // Use the optimal point when it stays near the edge, otherwise the best of the
+        // endpoints and the midpoint.
+        const auto& p0 = verts[v0];
+        const auto& p1 = verts[v1];
+        point3 target;
+        bool use_optimum = q.minimizer(target)
+                        && (target - 0.5 * (p0 + p1)).length() <= (p1 - p0).length();
+        if (!use_optimum) {
+            target = p0;
+            for (const auto& p : { p1, 0.5 * (p0 + p1) })
+                if (q.error(p) < q.error(target))
+                    target = p;
+        }
+
+        return collapse{ q.error(target), v0, v1, version[v0], version[v1], target };
+    };
+
+    std::priority_queue<collapse, std::vector<collapse>, std::greater<collapse>> heap;
+    for (const auto& f : faces)
+        for (int k = 0; k < 3; k++)
+            if (f[k] < f[(k + 1) % 3])
+                heap.push(evaluate(f[k], f[(k + 1) % 3]));
+
+    auto face_normal = [&](const std::array<int, 3>& f, int moved, const point3& p) {
+        auto at = [&](int k) -> const point3& { return f[k] == moved ? p : verts[f[k]]; };
+        return cross(at(1) - at(0), at(2) - at(0));
+    };
+
+    auto flips_face = [&](int v, int other, const point3& p) {
+        // True if moving v to p turns any surviving face around v upside down.
+        for (int f : vertex_faces[v]) {
+            const auto& face = faces[f];
+            if (face_removed[f] || face[0] == other || face[1] == other || face[2] == other)
+                continue;
+            if (dot(face_normal(face, v, verts[v]), face_normal(face, v, p)) <= 0)
+                return true;
+        }
+        return false;
+    };
+
+    size_t live_faces = faces.size();
+
+    while (live_faces > target_faces && !heap.empty()) {
+        auto c = heap.top();
+        heap.pop();
+
+        if (vertex_removed[c.v0] || vertex_removed[c.v1]
+            || version[c.v0] != c.version0 || version[c.v1] != c.version1)
+            continue;
+
+        if (flips_face(c.v0, c.v1, c.target) || flips_face(c.v1, c.v0, c.target))
+            continue;
+
+        // Collapse v1 into v0.
+        verts[c.v0] = c.target;
+        quadrics[c.v0] += quadrics[c.v1];
+        vertex_removed[c.v1] = true;
+        version[c.v0]++;
+
+        for (int f : vertex_faces[c.v1]) {
+            if (face_removed[f])
+                continue;
+
+            auto& face = faces[f];
+            if (face[0] == c.v0 || face[1] == c.v0 || face[2] == c.v0) {
+                face_removed[f] = true;
+                live_faces--;
+                continue;
+            }
+
+            for (auto& index : face)
+                if (index == c.v1)
+                    index = c.v0;
+            vertex_faces[c.v0].push_back(f);
+        }
+        vertex_faces[c.v1].clear();
+
+        auto& around = vertex_faces[c.v0];
+        around.erase(std::remove_if(around.begin(), around.end(),
+                                    [&](int f) { return face_removed[f]; }),
+                     around.end());
+
+        for (int f : around)
+            for (int index : faces[f])
+                if (index != c.v0)
+                    heap.push(evaluate(c.v0, index));
+    }
+
+    // Compact the surviving vertices and faces.
+    triangle_mesh result;
+    std::vector<int> remap(verts.size(), -1);
+    for (size_t f = 0; f < faces.size(); f++) {
+        if (face_removed[f])
+            continue;
+
+        std::array<int, 3> face;
+        for (int k = 0; k < 3; k++) {
+            int& index = remap[faces[f][k]];
+            if (index < 0) {
+                index = int(result.vertices.size());
+                result.vertices.push_back(verts[faces[f][k]]);
+            }
+            face[k] = index;
+        }
+        result.faces.push_back(face);
+    }
+
+    return result;
+}
+
+// Successively simplified copies of the mesh, each keeping about `ratio` of the previous
+// level's faces. Level 0 is the input mesh.
+inline std::vector<triangle_mesh> build_lod_chain(
+    const triangle_mesh& mesh, int max_levels, double ratio = 0.5, size_t min_faces = 64
+) {
+    std::vector<triangle_mesh> levels{ mesh };
+
+    while (int(levels.size()) < max_levels) {
+        auto target = size_t(levels.back().faces.size() * ratio);
+        if (target < min_faces)
+            break;
+
+        auto next = simplify(levels.back(), target);
+        if (next.faces.size() >= levels.back().faces.size())
+            break;
+
+        levels.push_back(std::move(next));
+    }
+
+    return levels;
+}
+
+#endif
\ No newline at end of file
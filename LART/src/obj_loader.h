@@ -5,18 +5,22 @@
 #include <sstream>
 #include <vector>
 
-inline std::shared_ptr<hittable_list> parseOBJ(const std::string filePath, shared_ptr<material> mat, double scale) {
+#include "lod_mesh.h"
+#include "quantized_mesh.h"
+
+inline triangle_mesh loadOBJ(const std::string filePath, double scale) {
+	triangle_mesh mesh;
+
 	std::ifstream fileStream(filePath);
 	if (!fileStream.is_open()) {
 		std::cerr << "Failed to open OBJ file: " << filePath << std::endl << std::endl;
-		return std::make_shared<hittable_list>();
+		return mesh;
 	}
 
     std::clog << "Opened OBJ file : " << filePath << std::endl << std::endl;
 
 	std::string line;
-	std::vector<point3> verts;
-	auto faces = std::make_shared<hittable_list>();
+	auto& verts = mesh.vertices;
 
     while (std::getline(fileStream, line)) {
         if (line.empty()) continue;
@@ -27,7 +31,7 @@ inline std::shared_ptr<hittable_list> parseOBJ(const std::string filePath, share
         if (token == "v") {
             double x, y, z;
             ls >> x >> y >> z;
-            verts.emplace_back(x, y, z);
+            verts.emplace_back(x * scale, y * scale, z * scale);
         }
         else if (token == "f") {
             std::vector<int> indices;
@@ -56,16 +60,47 @@ inline std::shared_ptr<hittable_list> parseOBJ(const std::string filePath, share
 
             // ֱӼ룻ʷ (0, i-1, i) ʽ
             if (indices.size() >= 3) {
-                for (size_t i = 1; i + 1 < indices.size(); ++i) {
-                    const vec3& a = verts[indices[0]];
-                    const vec3& b = verts[indices[i]];
-                    const vec3& c = verts[indices[i + 1]];
-                    faces->add(std::make_shared<triangle>(a * scale, b * scale, c * scale, mat));
-                }
+                for (size_t i = 1; i + 1 < indices.size(); ++i)
+                    mesh.faces.push_back({ indices[0], indices[i], indices[i + 1] });
             }
         }
     }
+	return mesh;
+}
+
+// With an arena, the triangles are allocated there (see arena.h).
+inline std::shared_ptr<hittable_list> parseOBJ(const std::string filePath, shared_ptr<material> mat, double scale, arena* storage = nullptr) {
+	auto mesh = loadOBJ(filePath, scale);
+	auto faces = make_in<hittable_list>(storage);
+
+	faces->objects.reserve(mesh.faces.size());
+	for (const auto& f : mesh.faces)
+		faces->add(make_in<triangle>(storage, mesh.vertices[f[0]], mesh.vertices[f[1]], mesh.vertices[f[2]], mat));
+
 	return faces;
 }
 
+// Loads the OBJ file together with up to max_levels quadric-simplified levels of detail.
+inline std::shared_ptr<lod_mesh> parseOBJLOD(const std::string filePath, shared_ptr<material> mat, double scale, int max_levels = 4) {
+	auto mesh = loadOBJ(filePath, scale);
+	auto lods = std::make_shared<lod_mesh>(build_lod_chain(mesh, max_levels), mat);
+
+	std::clog << "LOD chain :";
+	for (int l = 0; l < lods->level_count(); l++)
+		std::clog << " " << lods->triangle_count(l);
+	std::clog << " triangles" << std::endl << std::endl;
+
+	return lods;
+}
+
+// Loads the OBJ file into a quantized_mesh, for models too large to keep as triangle objects.
+inline std::shared_ptr<quantized_mesh> parseOBJQuantized(const std::string filePath, shared_ptr<material> mat, double scale) {
+	auto mesh = std::make_shared<quantized_mesh>(loadOBJ(filePath, scale), mat);
+
+	std::clog << "Quantized mesh : " << mesh->memory_bytes() / 1024 << " KB, max vertex error "
+	          << mesh->max_error() << std::endl << std::endl;
+
+	return mesh;
+}
+
 #endif
\ No newline at end of file
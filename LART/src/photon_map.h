@@ -0,0 +1,107 @@
+#ifndef PHOTON_MAP_H
+#define PHOTON_MAP_H
+
+#include "hittable.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Photon mapping (Jensen, "Global Illumination using Photon Maps", 1996) for caustics. Photons
+// leave the lights, bounce off specular surfaces and are stored where they land on a diffuse
+// one; the light a camera path sees there is then estimated from the photons around its hit
+// instead of from the rare path that finds the light through the glass on its own.
+
+// A photon stored on a non-specular surface.
+struct photon {
+    point3 p;
+    vec3   direction;  // Unit direction it travelled along to reach p
+    color  power;
+};
+
+// Photons sorted into a hashed uniform grid, for finding those within a fixed radius of a point.
+// Cells are twice the radius wide, so a query only visits the 2x2x2 cells nearest to it.
+class photon_map {
+  public:
+    photon_map() {}
+
+    photon_map(const std::vector<photon>& stored, double radius)
+        : radius(radius), cell_size(2 * radius)
+    {
+        size_t table_size = 1;
+        while (table_size < 2 * stored.size())
+            table_size *= 2;
+        mask = table_size - 1;
+
+        // Counting sort by cell: count, turn counts into starts, then place.
+        std::vector<uint32_t> cells(stored.size());
+        cell_start.assign(table_size + 1, 0);
+        for (size_t i = 0; i < stored.size(); i++) {
+            const auto& p = stored[i].p;
+            cells[i] = hash_cell(cell_of(p[0]), cell_of(p[1]), cell_of(p[2]));
+            cell_start[cells[i] + 1]++;
+        }
+        for (size_t c = 0; c < table_size; c++)
+            cell_start[c + 1] += cell_start[c];
+
+        photons.resize(stored.size());
+        auto next = cell_start;
+        for (size_t i = 0; i < stored.size(); i++)
+            photons[next[cells[i]]++] = stored[i];
+    }
+
+    bool empty() const { return photons.empty(); }
+
+    size_t size() const { return photons.size(); }
+
+    double gather_radius() const { return radius; }
+
+    // Calls f with every photon within the gather radius of p.
+    template <typename F>
+    void for_each_near(const point3& p, F&& f) const {
+        if (photons.empty())
+            return;
+
+        // The lower corner of the 2x2x2 cells: the cell holding p, less one on each axis where
+        // p lies in its lower half.
+        int64_t base[3];
+        for (int a = 0; a < 3; a++) {
+            auto x = p[a] / cell_size;
+            auto c = std::floor(x);
+            base[a] = int64_t(c) - (x - c < 0.5 ? 1 : 0);
+        }
+
+        // Distinct cells may share a hash bucket; each bucket is searched once.
+        uint32_t visited[8];
+        int visited_count = 0;
+        auto radius_squared = radius * radius;
+
+        for (int d = 0; d < 8; d++) {
+            auto bucket = hash_cell(base[0] + (d & 1), base[1] + ((d >> 1) & 1), base[2] + (d >> 2));
+            if (std::find(visited, visited + visited_count, bucket) != visited + visited_count)
+                continue;
+            visited[visited_count++] = bucket;
+
+            for (auto k = cell_start[bucket]; k < cell_start[bucket + 1]; k++)
+                if ((photons[k].p - p).length_squared() <= radius_squared)
+                    f(photons[k]);
+        }
+    }
+
+  private:
+    std::vector<photon> photons;       // Grouped by bucket
+    std::vector<uint32_t> cell_start;  // Photons of bucket b are [cell_start[b], cell_start[b + 1])
+    uint64_t mask = 0;
+    double radius = 0;
+    double cell_size = 1;
+
+    int64_t cell_of(double x) const { return int64_t(std::floor(x / cell_size)); }
+
+    uint32_t hash_cell(int64_t x, int64_t y, int64_t z) const {
+        auto key = uint64_t(x) * 0x9e3779b97f4a7c15ull ^ uint64_t(y) * 0xc2b2ae3d27d4eb4full
+                 ^ uint64_t(z) * 0x165667b19e3779f9ull;
+        return uint32_t(mix_bits(key) & mask);
+    }
+};
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef PLANE_H
+#define PLANE_H
+
+#include "hittable.h"
+
+// Infinite plane through Q. Its bounding box is unbounded, so bvh_node keeps it out of the tree.
+class plane : public hittable {
+  public:
+    plane(const point3& Q, const vec3& normal, shared_ptr<material> mat)
+        : Q(Q), normal(unit_vector(normal)), mat(mat)
+    {
+        D = dot(this->normal, Q);
+    }
+
+    aabb bounding_box() const override { return aabb::universe; }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        auto denom = dot(normal, r.direction());
+
+        // No hit if the ray is parallel to the plane.
+        if (std::fabs(denom) < 1e-8)
+            return false;
+
+        auto t = (D - dot(normal, r.origin())) / denom;
+        if (!ray_t.contains(t))
+            return false;
+
+        rec.t = t;
+        rec.u = 0;
+        rec.v = 0;
+        rec.object = this;
+
+        return true;
+    }
+
+    void set_hit_attributes(const ray& r, hit_record& rec) const override {
+        rec.p = r.at(rec.t);
+        rec.mat = mat.get();
+        rec.set_face_normal(r, normal);
+    }
+
+  private:
+    point3 Q;
+    vec3 normal;
+    shared_ptr<material> mat;
+    real D;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,216 @@
+#ifndef PRIMITIVE_BVH_H
+#define PRIMITIVE_BVH_H
+
+#include "bvh.h"
+#include "hittable_list.h"
+#include "quad.h"
+#include "sphere.h"
+#include "triangle.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <typeinfo>
+#include <vector>
+
+// Scene BVH over primitives stored by value. Spheres, quads and triangles are copied into one
+// contiguous array per type, in leaf order, and each leaf names a range in every array, so a
+// leaf test walks those arrays and calls hit() with no pointer chase or virtual dispatch.
+// Any other hittable (instances, meshes, user-defined classes) goes in a fallback array and
+// is still called through its shared_ptr. Nested hittable_lists are flattened into the tree.
+class primitive_bvh : public hittable {
+  public:
+    primitive_bvh(hittable_list list) {
+        // Unbounded and huge objects are kept out of the tree, as in bvh_node.
+        auto large = bvh_node::split_large_objects(list.objects);
+        if (!large.empty()) {
+            large_objects = make_shared<hittable_list>();
+            for (const auto& object : large)
+                large_objects->add(object);
+        }
+
+        std::vector<build_ref> refs;
+        for (const auto& object : list.objects)
+            gather(object, refs);
+
+        if (!refs.empty())
+            build(refs, 0, refs.size());
+
+        bbox = nodes.empty() ? aabb::empty : nodes[0].bbox;
+    }
+
+    // The arrays hold the primitives that hit records point back to.
+    primitive_bvh(const primitive_bvh&) = delete;
+    primitive_bvh& operator=(const primitive_bvh&) = delete;
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        bool hit_anything = large_objects && large_objects->hit(r, ray_t, rec);
+        if (hit_anything)
+            ray_t.max = rec.t;
+
+        if (nodes.empty())
+            return hit_anything;
+
+        uint32_t stack[64];
+        int stack_size = 0;
+        uint32_t current = 0;
+
+        while (true) {
+            const auto& n = nodes[current];
+
+            if (n.bbox.hit(r, ray_t)) {
+                if (n.leaf) {
+                    hit_anything |= hit_range(spheres, n, sphere_kind, r, ray_t, rec);
+                    hit_anything |= hit_range(quads, n, quad_kind, r, ray_t, rec);
+                    hit_anything |= hit_range(triangles, n, triangle_kind, r, ray_t, rec);
+
+                    for (uint32_t i = n.first[other_kind], e = i + n.count[other_kind]; i < e; i++) {
+                        if (others[i]->hit(r, ray_t, rec)) {
+                            hit_anything = true;
+                            ray_t.max = rec.t;
+                        }
+                    }
+                }
+                else {
+                    // Visit the child nearer to the ray origin first.
+                    uint32_t near = current + 1, far = n.right;
+                    if (r.direction()[n.axis] < 0)
+                        std::swap(near, far);
+                    stack[stack_size++] = far;
+                    current = near;
+                    continue;
+                }
+            }
+
+            if (stack_size == 0)
+                break;
+            current = stack[--stack_size];
+        }
+
+        return hit_anything;
+    }
+
+    aabb bounding_box() const override {
+        return large_objects ? aabb(bbox, large_objects->bounding_box()) : bbox;
+    }
+
+    void collect_lights(std::vector<const hittable*>& lights) const override {
+        // Reports the copies held here, which are what hit records point to.
+        if (large_objects)
+            large_objects->collect_lights(lights);
+        for (const auto& q : quads)
+            q.collect_lights(lights);
+        for (const auto& t : triangles)
+            t.collect_lights(lights);
+        for (const auto& object : others)
+            object->collect_lights(lights);
+    }
+
+    static constexpr size_t max_leaf_size = 4;
+
+  private:
+    enum kind : uint8_t { sphere_kind, quad_kind, triangle_kind, other_kind, kind_count };
+
+    struct node {
+        aabb bbox;
+        uint32_t right = 0;                // Second child of an interior node; the first follows it
+        uint32_t first[kind_count] = {};   // Leaves: first primitive of each kind
+        uint8_t count[kind_count] = {};    // Leaves: number of primitives of each kind
+        uint8_t axis = 0;                  // Split axis for interior nodes
+        bool leaf = false;
+    };
+
+    struct build_ref {
+        kind type;
+        shared_ptr<hittable> object;
+        aabb box;
+    };
+
+    std::vector<sphere> spheres;
+    std::vector<quad> quads;
+    std::vector<triangle> triangles;
+    std::vector<shared_ptr<hittable>> others;
+    std::vector<node> nodes;
+    shared_ptr<hittable_list> large_objects;
+    aabb bbox;
+
+    template <typename T>
+    static bool hit_range(
+        const std::vector<T>& items, const node& n, kind type, const ray& r, interval& ray_t,
+        hit_record& rec
+    ) {
+        bool hit_anything = false;
+        for (uint32_t i = n.first[type], e = i + n.count[type]; i < e; i++) {
+            // Qualified call: the element type is exact, so skip the virtual dispatch.
+            if (items[i].T::hit(r, ray_t, rec)) {
+                hit_anything = true;
+                ray_t.max = rec.t;
+            }
+        }
+        return hit_anything;
+    }
+
+    static void gather(const shared_ptr<hittable>& object, std::vector<build_ref>& refs) {
+        // Only exact types go in the typed arrays; a subclass of quad, say, may override hit().
+        const auto& type = typeid(*object);
+
+        if (type == typeid(hittable_list)) {
+            for (const auto& child : static_cast<const hittable_list&>(*object).objects)
+                gather(child, refs);
+            return;
+        }
+
+        kind k = (type == typeid(sphere))   ? sphere_kind
+               : (type == typeid(quad))     ? quad_kind
+               : (type == typeid(triangle)) ? triangle_kind
+                                            : other_kind;
+        refs.push_back({ k, object, object->bounding_box() });
+    }
+
+    uint32_t build(std::vector<build_ref>& refs, size_t start, size_t end) {
+        auto index = uint32_t(nodes.size());
+        nodes.emplace_back();
+
+        node n;
+        n.bbox = aabb::empty;
+        for (size_t i = start; i < end; i++)
+            n.bbox = aabb(n.bbox, refs[i].box);
+
+        if (end - start <= max_leaf_size) {
+            n.leaf = true;
+            n.first[sphere_kind] = uint32_t(spheres.size());
+            n.first[quad_kind] = uint32_t(quads.size());
+            n.first[triangle_kind] = uint32_t(triangles.size());
+            n.first[other_kind] = uint32_t(others.size());
+
+            // Primitives are appended in leaf order, so each leaf owns a contiguous range.
+            for (size_t i = start; i < end; i++) {
+                const auto& object = *refs[i].object;
+                switch (refs[i].type) {
+                    case sphere_kind:   spheres.push_back(static_cast<const sphere&>(object)); break;
+                    case quad_kind:     quads.push_back(static_cast<const quad&>(object)); break;
+                    case triangle_kind: triangles.push_back(static_cast<const triangle&>(object)); break;
+                    default:            others.push_back(refs[i].object); break;
+                }
+                n.count[refs[i].type]++;
+            }
+
+            nodes[index] = n;
+            return index;
+        }
+
+        // Same split as bvh_node: median along the longest axis, ordered by box minimum.
+        int axis = n.bbox.longest_axis();
+        std::sort(refs.begin() + start, refs.begin() + end, [axis](const auto& a, const auto& b) {
+            return a.box.axis_interval(axis).min < b.box.axis_interval(axis).min;
+        });
+
+        auto mid = start + (end - start) / 2;
+        build(refs, start, mid);
+        n.right = build(refs, mid, end);
+        n.axis = uint8_t(axis);
+        nodes[index] = n;
+        return index;
+    }
+};
+
+#endif
\ No newline at end of file
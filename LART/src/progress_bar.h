@@ -49,7 +49,7 @@ class progress_bar {
         std::clog << oss.str() << std::flush;
     }
 
-    void end(double average_sample_count) {
+    void end(double average_sample_count, long long ray_count) {
         auto end = std::chrono::high_resolution_clock::now();
         auto total = std::chrono::duration_cast<std::chrono::duration<double>>(end - start);
 
@@ -58,6 +58,7 @@ class progress_bar {
         std::clog << reset << "] 100% Done.\nTotal time: " << int(total.count()) << "s          \n";
 
         std::clog << "Average sample count = " << average_sample_count << "\n";
+        std::clog << "Rays per second = " << ray_count / total.count() / 1e6 << "M\n";
     }
 
   private:
@@ -3,6 +3,7 @@
 
 #include "hittable.h"
 #include "hittable_list.h"
+#include "material.h"
 
 class quad : public hittable {
   public:
@@ -11,9 +12,11 @@ class quad : public hittable {
     {
         auto n = cross(u, v);
         normal = unit_vector(n);
+        area = n.length();
         D = dot(normal, Q);
         w = n / dot(n, n);
 
+        set_axis_alignment();
         set_bounding_box();
     }
 
@@ -27,6 +30,9 @@ class quad : public hittable {
     aabb bounding_box() const override { return bbox; }
 
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        if (plane_axis >= 0)
+            return hit_axis_aligned(r, ray_t, rec);
+
         auto denom = dot(normal, r.direction());
 
         // No hit if the ray is parallel to the plane.
@@ -47,16 +53,50 @@ class quad : public hittable {
         if (!is_interior(alpha, beta, rec))
             return false;
 
-        // Ray hits the 2D shape; set the rest of the hit record and return true.
+        // Ray hits the 2D shape; the rest of the hit record is set once it is the closest hit.
         rec.t = t;
-        rec.p = intersection;
-        rec.mat = mat;
-        rec.set_face_normal(r, normal);
+        rec.object = this;
 
         return true;
     }
 
-    virtual bool is_interior(double a, double b, hit_record& rec) const {
+    void set_hit_attributes(const ray& r, hit_record& rec) const override {
+        rec.p = r.at(rec.t);
+        rec.mat = mat.get();
+        rec.set_face_normal(r, normal);
+    }
+
+    void collect_lights(std::vector<const hittable*>& lights) const override {
+        if (mat->kind == material_kind::diffuse_light)
+            lights.push_back(this);
+    }
+
+    double pdf_value(const point3& origin, const vec3& direction) const override {
+        hit_record rec;
+        if (!this->hit(ray(origin, direction), interval(0.001, infinity), rec))
+            return 0;
+
+        auto distance_squared = rec.t * rec.t * direction.length_squared();
+        auto cosine = std::fabs(dot(direction, normal) / direction.length());
+
+        return distance_squared / (cosine * area);
+    }
+
+    vec3 random(const point3& origin, const vec3& sample) const override {
+        auto p = Q + (sample.x() * u) + (sample.y() * v);
+        return p - origin;
+    }
+
+    double emitted_power() const override {
+        auto L = emitted_radiance();
+        return 2 * pi * area * (L.x() + L.y() + L.z()) / 3;
+    }
+
+    vec3 emitting_normal() const override { return normal; }
+
+    color emitted_radiance() const override { return mat->emitted(0.5, 0.5, Q + 0.5 * (u + v)); }
+
+    virtual bool is_interior(real a, real b, hit_record& rec) const {
         interval unit_interval = interval(0, 1);
         // Given the hit point in plane coordinates, return false if it is outside the
         // primitive, otherwise set the hit record UV coordinates and return true.
@@ -76,7 +116,59 @@ class quad : public hittable {
     shared_ptr<material> mat;
     aabb bbox;
     vec3 normal;
-    double D;
+    real D;
+    real area;
+
+    // Axis-aligned fast path, used when u and v each run along a single coordinate axis.
+    int plane_axis = -1;
+    int u_axis, v_axis;
+    real u_inv, v_inv;
+
+    void set_axis_alignment() {
+        auto single_axis = [](const vec3& e) {
+            int axis = -1;
+            for (int i = 0; i < 3; i++) {
+                if (e[i] == 0) continue;
+                if (axis >= 0) return -1;
+                axis = i;
+            }
+            return axis;
+        };
+
+        u_axis = single_axis(u);
+        v_axis = single_axis(v);
+        if (u_axis < 0 || v_axis < 0 || u_axis == v_axis)
+            return;
+
+        plane_axis = 3 - u_axis - v_axis;
+        u_inv = 1 / u[u_axis];
+        v_inv = 1 / v[v_axis];
+    }
+
+    bool hit_axis_aligned(const ray& r, interval ray_t, hit_record& rec) const {
+        // Same result as the general path, but the plane is Q[plane_axis] and the plane
+        // coordinates fall out of a single component each.
+        auto denom = r.direction()[plane_axis];
+
+        if (std::fabs(denom) < 1e-8)
+            return false;
+
+        auto t = (Q[plane_axis] - r.origin()[plane_axis]) / denom;
+        if (!ray_t.contains(t))
+            return false;
+
+        auto intersection = r.at(t);
+        auto alpha = (intersection[u_axis] - Q[u_axis]) * u_inv;
+        auto beta = (intersection[v_axis] - Q[v_axis]) * v_inv;
+
+        if (!is_interior(alpha, beta, rec))
+            return false;
+
+        rec.t = t;
+        rec.object = this;
+
+        return true;
+    }
 };
 
 inline shared_ptr<hittable_list> box(const point3& a, const point3& b, shared_ptr<material> mat)
@@ -0,0 +1,235 @@
+#ifndef QUANTIZED_MESH_H
+#define QUANTIZED_MESH_H
+
+#include "hittable.h"
+#include "material.h"
+#include "mesh.h"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// Compact triangle mesh for very large models. Vertex positions are stored as 16-bit offsets
+// on a grid spanning the mesh bounding box and decoded inside the triangle test, and the mesh
+// carries its own BVH whose node bounds live on the same grid. That costs about 30 bytes
+// per triangle, instead of several hundred for individual triangle objects.
+class quantized_mesh : public hittable {
+  public:
+    quantized_mesh(const triangle_mesh& mesh, shared_ptr<material> mat) : mat(mat) {
+        auto box = mesh.bounding_box();
+        origin = point3(box.x.min, box.y.min, box.z.min);
+        step = vec3(box.x.size(), box.y.size(), box.z.size()) / grid_max;
+
+        positions.reserve(mesh.vertices.size());
+        for (const auto& p : mesh.vertices) {
+            std::array<uint16_t, 3> q;
+            for (int a = 0; a < 3; a++)
+                q[a] = uint16_t(std::clamp(std::round(double(p[a] - origin[a]) / step[a]), 0.0, grid_max));
+            positions.push_back(q);
+        }
+
+        faces.reserve(mesh.faces.size());
+        for (const auto& f : mesh.faces)
+            faces.push_back({ uint32_t(f[0]), uint32_t(f[1]), uint32_t(f[2]) });
+
+        if (!faces.empty())
+            build(0, faces.size());
+
+        bbox = faces.empty() ? aabb::empty : node_box(nodes[0]);
+
+        // Faces are not hittables of their own, so they cannot be sampled as lights.
+        if (mat->kind == material_kind::diffuse_light)
+            std::cerr << "Emissive quantized_mesh is not sampled as a light; use triangles" << std::endl;
+    }
+
+    // Largest distance between a decoded vertex and the vertex it was loaded from.
+    real max_error() const { return step.length() / 2; }
+
+    size_t memory_bytes() const {
+        return positions.size() * sizeof(positions[0])
+             + faces.size() * sizeof(faces[0])
+             + nodes.size() * sizeof(nodes[0]);
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        if (nodes.empty())
+            return false;
+
+        bool hit_anything = false;
+        uint32_t stack[64];
+        int stack_size = 0;
+        uint32_t current = 0;
+
+        while (true) {
+            const auto& n = nodes[current];
+
+            if (node_box(n).hit(r, ray_t)) {
+                if (n.count > 0) {
+                    for (uint32_t f = n.offset; f < n.offset + n.count; f++) {
+                        if (hit_face(f, r, ray_t, rec)) {
+                            hit_anything = true;
+                            ray_t.max = rec.t;
+                        }
+                    }
+                }
+                else {
+                    // Visit the child nearer to the ray origin first.
+                    uint32_t near = current + 1, far = n.offset;
+                    if (r.direction()[n.axis] < 0)
+                        std::swap(near, far);
+                    stack[stack_size++] = far;
+                    current = near;
+                    continue;
+                }
+            }
+
+            if (stack_size == 0)
+                break;
+            current = stack[--stack_size];
+        }
+
+        return hit_anything;
+    }
+
+    void set_hit_attributes(const ray& r, hit_record& rec) const override {
+        const auto& f = faces[rec.primitive];
+        auto v0 = decode(f[0]);
+        auto normal = unit_vector(cross(decode(f[1]) - v0, decode(f[2]) - v0));
+
+        rec.p = r.at(rec.t);
+        rec.mat = mat.get();
+        rec.set_face_normal(r, normal);
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+  private:
+    static constexpr double grid_max = 65535.0;
+    static constexpr size_t max_leaf_size = 4;
+
+    struct node {
+        std::array<uint16_t, 3> lo, hi; // Bounds on the quantization grid
+        uint32_t offset;                // First face for leaves, right child for interior nodes
+        uint16_t count;                 // Face count for leaves, 0 for interior nodes
+        uint8_t axis;                   // Split axis for interior nodes
+    };
+
+    point3 origin;
+    vec3 step;
+    std::vector<std::array<uint16_t, 3>> positions;
+    std::vector<std::array<uint32_t, 3>> faces;
+    std::vector<node> nodes;
+    shared_ptr<material> mat;
+    aabb bbox;
+
+    point3 decode(uint32_t index) const {
+        const auto& q = positions[index];
+        return point3(origin.x() + q[0] * step.x(),
+                      origin.y() + q[1] * step.y(),
+                      origin.z() + q[2] * step.z());
+    }
+
+    aabb node_box(const node& n) const {
+        // Decoding is monotonic in the grid coordinate, so this box holds every decoded vertex
+        // below the node.
+        return aabb(point3(origin.x() + n.lo[0] * step.x(),
+                           origin.y() + n.lo[1] * step.y(),
+                           origin.z() + n.lo[2] * step.z()),
+                    point3(origin.x() + n.hi[0] * step.x(),
+                           origin.y() + n.hi[1] * step.y(),
+                           origin.z() + n.hi[2] * step.z()));
+    }
+
+    bool hit_face(uint32_t f, const ray& r, interval ray_t, hit_record& rec) const {
+        // Same test as triangle::hit, on the decoded vertices.
+        auto v0 = decode(faces[f][0]);
+        auto E1 = decode(faces[f][1]) - v0;
+        auto E2 = decode(faces[f][2]) - v0;
+
+        auto P = cross(r.direction(), E2);
+        real det = dot(E1, P);
+
+        if (std::fabs(det) < 1e-8)
+            return false;
+
+        real invDet = 1 / det;
+        auto T = r.origin() - v0;
+
+        auto u = dot(T, P) * invDet;
+        if (u < 0.0 || u > 1.0)
+            return false;
+
+        auto Q = cross(T, E1);
+        auto v = dot(r.direction(), Q) * invDet;
+        if (v < 0.0 || u + v > 1.0)
+            return false;
+
+        auto t = dot(E2, Q) * invDet;
+        if (!ray_t.contains(t))
+            return false;
+
+        rec.t = t;
+        rec.u = u;
+        rec.v = v;
+        rec.object = this;
+        rec.primitive = f;
+
+        return true;
+    }
+
+    uint32_t build(size_t start, size_t end) {
+        auto index = uint32_t(nodes.size());
+        nodes.emplace_back();
+
+        node n;
+        n.lo = { 0xffff, 0xffff, 0xffff };
+        n.hi = { 0, 0, 0 };
+        std::array<double, 3> centroid_min{ infinity, infinity, infinity };
+        std::array<double, 3> centroid_max{ -infinity, -infinity, -infinity };
+
+        for (size_t f = start; f < end; f++) {
+            for (int a = 0; a < 3; a++) {
+                uint16_t lo = 0xffff, hi = 0;
+                for (auto v : faces[f]) {
+                    lo = std::min(lo, positions[v][a]);
+                    hi = std::max(hi, positions[v][a]);
+                }
+                n.lo[a] = std::min(n.lo[a], lo);
+                n.hi[a] = std::max(n.hi[a], hi);
+                centroid_min[a] = std::fmin(centroid_min[a], 0.5 * (lo + hi));
+                centroid_max[a] = std::fmax(centroid_max[a], 0.5 * (lo + hi));
+            }
+        }
+
+        int axis = 0;
+        for (int a = 1; a < 3; a++)
+            if (centroid_max[a] - centroid_min[a] > centroid_max[axis] - centroid_min[axis])
+                axis = a;
+        n.axis = uint8_t(axis);
+
+        if (end - start <= max_leaf_size) {
+            n.offset = uint32_t(start);
+            n.count = uint16_t(end - start);
+            nodes[index] = n;
+            return index;
+        }
+
+        auto centroid = [&](const std::array<uint32_t, 3>& f) {
+            auto lo = std::min({ positions[f[0]][axis], positions[f[1]][axis], positions[f[2]][axis] });
+            auto hi = std::max({ positions[f[0]][axis], positions[f[1]][axis], positions[f[2]][axis] });
+            return lo + hi;
+        };
+
+        auto mid = start + (end - start) / 2;
+        std::nth_element(faces.begin() + start, faces.begin() + mid, faces.begin() + end,
+                         [&](const auto& a, const auto& b) { return centroid(a) < centroid(b); });
+
+        build(start, mid);
+        n.offset = build(mid, end);
+        n.count = 0;
+        nodes[index] = n;
+        return index;
+    }
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,98 @@
+#ifndef RADIANCE_CACHE_H
+#define RADIANCE_CACHE_H
+
+#include "hittable.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// World-space cache of the light leaving diffuse surfaces, in the spirit of hash-grid radiance
+// caching (Binder et al., "Massively Parallel Path Space Filtering", 2019). Space is cut into
+// cells that grow with distance from the camera, split by which way the surface faces. Paths
+// record what they find at diffuse hits; later paths end at a diffuse hit whose cell has
+// enough records and take the cell's mean instead of tracing on. Cells store that light
+// divided by the albedo, so surfaces of different colors may share one.
+class radiance_cache {
+  public:
+    radiance_cache() {}
+
+    // A cache for `threads` threads recording at once into `tiles` image tiles, whose cells are
+    // used from min_records on.
+    radiance_cache(int threads, int tiles, long long min_records)
+        : pending(threads), tile_records(tiles), min_records(min_records) {}
+
+    bool empty() const { return cells.empty(); }
+
+    // Whether paths record into this cache; not for the empty default one.
+    bool recording() const { return !pending.empty(); }
+
+    // Cell of point p on a surface facing normal, cell_size wide (a power of two).
+    static uint64_t cell_key(const point3& p, const vec3& normal, double cell_size) {
+        // The normal's largest component and its sign pick one of six facings.
+        int axis = std::fabs(normal.x()) > std::fabs(normal.y())
+                 ? (std::fabs(normal.x()) > std::fabs(normal.z()) ? 0 : 2)
+                 : (std::fabs(normal.y()) > std::fabs(normal.z()) ? 1 : 2);
+        int facing = 2 * axis + (normal[axis] < 0 ? 1 : 0);
+
+        int level = std::ilogb(cell_size);
+        uint64_t key = mix_bits(uint64_t(level + 1024) << 3 | uint64_t(facing));
+        for (int a = 0; a < 3; a++)
+            key = mix_bits(key ^ uint64_t(int64_t(std::floor(p[a] / cell_size))));
+        return key;
+    }
+
+    // Mean of the cell's records, if it has enough of them.
+    bool lookup(uint64_t key, color& value) const {
+        auto it = cells.find(key);
+        if (it == cells.end() || it->second.count < min_records)
+            return false;
+        value = color(it->second.sum / double(it->second.count));
+        return true;
+    }
+
+    // Adds a record to thread's pending records; lookups see it after the next update().
+    void record(int thread, uint64_t key, const color& value) {
+        add(pending[thread], key, cell{ basic_vec3<double>(value), 1 });
+    }
+
+    // Hands the records thread made since its last call over to tile, the one it just finished.
+    void end_tile(int thread, int tile) {
+        for (const auto& [key, c] : pending[thread])
+            add(tile_records[tile], key, c);
+        pending[thread].clear();
+    }
+
+    // Ends a pass: the tiles' records join those of all earlier passes. Sums are taken tile by
+    // tile in order, so the cache does not depend on which thread rendered which tile.
+    void update() {
+        for (auto& records : tile_records) {
+            for (const auto& [key, c] : records)
+                add(cells, key, c);
+            records.clear();
+        }
+    }
+
+    size_t size() const { return cells.size(); }
+
+  private:
+    struct cell {
+        basic_vec3<double> sum;
+        long long count = 0;
+    };
+
+    using cell_map = std::unordered_map<uint64_t, cell>;
+
+    std::vector<cell_map> pending;       // Per thread, its current tile
+    std::vector<cell_map> tile_records;  // Per tile, this pass
+    cell_map cells;                      // All earlier passes
+    long long min_records = 0;
+
+    static void add(cell_map& cells, uint64_t key, const cell& c) {
+        auto& total = cells[key];
+        total.sum += c.sum;
+        total.count += c.count;
+    }
+};
+
+#endif
@@ -3,22 +3,47 @@
 
 #include "vec3.h"
 
-class ray {
+template <typename T>
+class basic_ray {
   public:
-    ray() {}
+    basic_ray() {}
 
-    ray(const point3& origin, const vec3& direction) : orig(origin), dir(direction) {}
+    basic_ray(const basic_vec3<T>& origin, const basic_vec3<T>& direction)
+        : orig(origin), dir(direction) { set_slab_terms(); }
 
-    const point3& origin() const { return orig; }
-    const vec3& direction() const { return dir; }
+    basic_ray(const basic_vec3<T>& origin, const basic_vec3<T>& direction, int depth)
+        : orig(origin), dir(direction), path_depth(depth) { set_slab_terms(); }
 
-    point3 at(double t) const {
+    const basic_vec3<T>& origin() const { return orig; }
+    const basic_vec3<T>& direction() const { return dir; }
+
+    // Per-ray terms for box tests: 1/direction, and per axis whether the direction is negative
+    // (the ray then enters a slab through its max side).
+    const basic_vec3<T>& inv_direction() const { return inv_dir; }
+    bool negative(int axis) const { return neg[axis]; }
+
+    // Number of scattering events on the path before this ray.
+    int depth() const { return path_depth; }
+
+    basic_vec3<T> at(T t) const {
         return orig + t * dir;
     }
 
   private:
-    point3 orig;
-    vec3 dir;
+    basic_vec3<T> orig;
+    basic_vec3<T> dir;
+    basic_vec3<T> inv_dir;
+    bool neg[3] = {};
+    int path_depth = 0;
+
+    void set_slab_terms() {
+        for (int axis = 0; axis < 3; axis++) {
+            inv_dir[axis] = 1 / dir[axis];
+            neg[axis] = inv_dir[axis] < 0;
+        }
+    }
 };
 
+using ray = basic_ray<real>;
+
 #endif
\ No newline at end of file
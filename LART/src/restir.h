@@ -0,0 +1,49 @@
+#ifndef RESTIR_H
+#define RESTIR_H
+
+#include "hittable.h"
+
+// Building blocks for reservoir-based direct lighting (ReSTIR, Bitterli et al. 2020). The
+// camera draws a few cheap light samples per pixel, keeps one in a reservoir with probability
+// proportional to its estimated contribution, and then merges reservoirs across neighbouring
+// pixels and across frames, so each pixel shades with the best of many more candidates than it
+// paid for.
+
+// A point on an emitter: the candidate a reservoir holds.
+struct light_sample {
+    const hittable* light = nullptr;
+    point3 p;
+    vec3 normal;
+    color emitted;
+};
+
+// Weighted reservoir over light samples. Streams candidates, keeps one with probability
+// proportional to its weight, and counts how many it has seen; finalize() then sets W so that
+// f(sample) * W estimates the integral whose integrand f the weights were built from.
+class light_reservoir {
+  public:
+    light_sample sample;
+    double weight_sum = 0;
+    double count = 0;  // Candidates seen, including those behind merged reservoirs
+    double W = 0;      // Unbiased contribution weight of sample
+
+    void add(const light_sample& candidate, double weight, double candidate_count = 1) {
+        weight_sum += weight;
+        count += candidate_count;
+        if (weight > 0 && random_double() * weight_sum < weight)
+            sample = candidate;
+    }
+
+    // Merges another reservoir, whose sample has target density `target` at this pixel.
+    void merge(const light_reservoir& other, double target) {
+        add(other.sample, target * other.W * other.count, other.count);
+    }
+
+    void finalize(double target) {
+        W = (target > 0 && count > 0) ? weight_sum / (count * target) : 0;
+    }
+
+    bool empty() const { return !sample.light || W <= 0; }
+};
+
+#endif
\ No newline at end of file
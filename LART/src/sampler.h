@@ -0,0 +1,281 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include "vec3.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <memory>
+
+// Source of the numbers in [0,1) that a camera path consumes: pixel position, lens position,
+// then per bounce whatever light sampling, scattering and Russian roulette draw. Each path is
+// one sample index of its pixel, and each number it draws is the next dimension of that sample,
+// so a sampler may spread the samples of a pixel evenly over every dimension instead of
+// drawing them independently.
+class sampler {
+  public:
+    virtual ~sampler() = default;
+
+    // Starts sample `index` of pixel (x, y); dimensions count from zero again.
+    virtual void start_pixel_sample(int x, int y, int index) = 0;
+
+    virtual double get_1d() = 0;
+
+    // Two dimensions at once, as (u, v, 0).
+    virtual vec3 get_2d() = 0;
+
+    // A sampler of the same kind and settings, for another thread.
+    virtual std::unique_ptr<sampler> clone() const = 0;
+};
+
+// Hashing helpers shared by the samplers below.
+
+inline uint64_t hash_ints(uint64_t a, uint64_t b) {
+    return mix_bits(a ^ (b + 0x9e3779b97f4a7c15ull) * 0xbf58476d1ce4e5b9ull);
+}
+
+inline uint64_t hash_ints(uint64_t a, uint64_t b, uint64_t c) {
+    return hash_ints(hash_ints(a, b), c);
+}
+
+inline double hash_to_unit(uint64_t h) {
+    return double(h >> 11) * 0x1p-53;
+}
+
+inline double bits_to_unit(uint32_t bits) {
+    return std::fmin(bits * 0x1p-32, 0x1.fffffffffffffp-1);
+}
+
+inline int permutation_element(uint32_t i, uint32_t n, uint32_t seed) {
+    // Element i of a random permutation of [0, n) chosen by seed, without building it
+    // (Kensler, "Correlated Multi-Jittered Sampling", 2013).
+    uint32_t w = n - 1;
+    w |= w >> 1;
+    w |= w >> 2;
+    w |= w >> 4;
+    w |= w >> 8;
+    w |= w >> 16;
+    do {
+        i ^= seed;
+        i *= 0xe170893d;
+        i ^= seed >> 16;
+        i ^= (i & w) >> 4;
+        i ^= seed >> 8;
+        i *= 0x0929eb3f;
+        i ^= seed >> 23;
+        i ^= (i & w) >> 1;
+        i *= 1 | seed >> 27;
+        i *= 0x6935fa69;
+        i ^= (i & w) >> 11;
+        i *= 0x74dcb303;
+        i ^= (i & w) >> 2;
+        i *= 0x9e501cc3;
+        i ^= (i & w) >> 2;
+        i *= 0xc860a3df;
+        i &= w;
+        i ^= i >> 5;
+    } while (i >= n);
+    return int((i + seed) % n);
+}
+
+// Plain Monte Carlo: every number independent.
+class independent_sampler : public sampler {
+  public:
+    void start_pixel_sample(int /*x*/, int /*y*/, int /*index*/) override {}
+
+    double get_1d() override { return random_double(); }
+
+    vec3 get_2d() override { return vec3(random_double(), random_double(), 0); }
+
+    std::unique_ptr<sampler> clone() const override { return std::make_unique<independent_sampler>(*this); }
+};
+
+// Jittered strata. Every run of `strata` consecutive samples of a pixel puts one sample in each
+// of `strata` equal intervals of a 1D dimension, and in each cell of a k x k grid of a 2D one
+// (k = sqrt(strata), so square counts stratify best). Strata are visited in a random order per
+// pixel, dimension and run.
+class stratified_sampler : public sampler {
+  public:
+    explicit stratified_sampler(int strata = 16, uint64_t seed = 0)
+        : strata(std::max(1, strata)), seed(seed)
+    {
+        grid = std::max(1, int(std::sqrt(double(this->strata))));
+    }
+
+    void start_pixel_sample(int x, int y, int index) override {
+        pixel = hash_ints(uint64_t(x), uint64_t(y), seed);
+        sample_index = index;
+        dimension = 0;
+    }
+
+    double get_1d() override {
+        auto h = hash_ints(pixel, dimension, uint64_t(sample_index / strata));
+        int stratum = permutation_element(uint32_t(sample_index % strata), uint32_t(strata), uint32_t(h));
+        auto jitter = hash_to_unit(hash_ints(h, uint64_t(sample_index)));
+        dimension++;
+        return (stratum + jitter) / strata;
+    }
+
+    vec3 get_2d() override {
+        int cells = grid * grid;
+        auto h = hash_ints(pixel, dimension, uint64_t(sample_index / cells));
+        int cell = permutation_element(uint32_t(sample_index % cells), uint32_t(cells), uint32_t(h));
+        auto jitter_u = hash_to_unit(hash_ints(h, uint64_t(sample_index), 0));
+        auto jitter_v = hash_to_unit(hash_ints(h, uint64_t(sample_index), 1));
+        dimension += 2;
+        return vec3((cell % grid + jitter_u) / grid, (cell / grid + jitter_v) / grid, 0);
+    }
+
+    std::unique_ptr<sampler> clone() const override { return std::make_unique<stratified_sampler>(*this); }
+
+  private:
+    int strata;
+    int grid;
+    uint64_t seed;
+    uint64_t pixel = 0;
+    int sample_index = 0;
+    uint64_t dimension = 0;
+};
+
+// Halton sequence: dimension d is the radical inverse of the sample index in the d-th prime
+// base. Each pixel and dimension adds its own random offset modulo 1 (Cranley-Patterson
+// rotation), so neighbouring pixels do not repeat the same points. Dimensions past the prime
+// table fall back to independent numbers.
+class halton_sampler : public sampler {
+  public:
+    explicit halton_sampler(uint64_t seed = 0) : seed(seed) {}
+
+    void start_pixel_sample(int x, int y, int index) override {
+        pixel = hash_ints(uint64_t(x), uint64_t(y), seed);
+        sample_index = uint64_t(index);
+        dimension = 0;
+    }
+
+    double get_1d() override {
+        if (dimension >= prime_count) {
+            dimension++;
+            return random_double();
+        }
+
+        auto value = radical_inverse(primes[dimension], sample_index) + hash_to_unit(hash_ints(pixel, dimension));
+        dimension++;
+        return std::fmin(value - std::floor(value), 0x1.fffffffffffffp-1);
+    }
+
+    vec3 get_2d() override {
+        auto u = get_1d();
+        auto v = get_1d();
+        return vec3(u, v, 0);
+    }
+
+    std::unique_ptr<sampler> clone() const override { return std::make_unique<halton_sampler>(*this); }
+
+  private:
+    static constexpr int prime_count = 32;
+    static constexpr int primes[prime_count] = {
+        2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53,
+        59, 61, 67, 71, 73, 79, 83, 89, 97, 101, 103, 107, 109, 113, 127, 131
+    };
+
+    uint64_t seed;
+    uint64_t pixel = 0;
+    uint64_t sample_index = 0;
+    int dimension = 0;
+
+    static double radical_inverse(int base, uint64_t a) {
+        // Mirrors the base-b digits of a about the radix point.
+        double inverse_base = 1.0 / base;
+        double inverse_base_power = 1;
+        uint64_t reversed = 0;
+        while (a) {
+            uint64_t next = a / base;
+            reversed = reversed * base + (a - next * base);
+            inverse_base_power *= inverse_base;
+            a = next;
+        }
+        return reversed * inverse_base_power;
+    }
+};
+
+// Owen-scrambled Sobol points, after Burley, "Practical Hash-based Owen Scrambling" (2020).
+// Every 1D or 2D request uses the first Sobol dimensions, made independent of the others by
+// shuffling the sample index and scrambling the digits with hashes of pixel and dimension.
+// Any power-of-two run of a pixel's samples is well stratified in each request, and the
+// sequence is progressive, so it suits the adaptive sampler's uneven sample counts.
+class sobol_sampler : public sampler {
+  public:
+    explicit sobol_sampler(uint64_t seed = 0) : seed(seed) {}
+
+    void start_pixel_sample(int x, int y, int index) override {
+        pixel = hash_ints(uint64_t(x), uint64_t(y), seed);
+        sample_index = uint32_t(index);
+        dimension = 0;
+    }
+
+    double get_1d() override {
+        auto h = hash_ints(pixel, dimension);
+        auto index = nested_uniform_scramble(sample_index, uint32_t(h));
+        dimension++;
+        return bits_to_unit(nested_uniform_scramble(reverse_bits(index), uint32_t(h >> 32)));
+    }
+
+    vec3 get_2d() override {
+        auto h = hash_ints(pixel, dimension);
+        auto index = nested_uniform_scramble(sample_index, uint32_t(h));
+        auto u = nested_uniform_scramble(reverse_bits(index), uint32_t(h >> 32));
+        auto v = nested_uniform_scramble(sobol_second_dimension(index), uint32_t(mix_bits(h)));
+        dimension += 2;
+        return vec3(bits_to_unit(u), bits_to_unit(v), 0);
+    }
+
+    std::unique_ptr<sampler> clone() const override { return std::make_unique<sobol_sampler>(*this); }
+
+  private:
+    uint64_t seed;
+    uint64_t pixel = 0;
+    uint32_t sample_index = 0;
+    uint64_t dimension = 0;
+
+    static uint32_t reverse_bits(uint32_t v) {
+        // Also the first Sobol dimension, as a 32-bit fraction.
+        v = ((v >> 1) & 0x55555555) | ((v & 0x55555555) << 1);
+        v = ((v >> 2) & 0x33333333) | ((v & 0x33333333) << 2);
+        v = ((v >> 4) & 0x0f0f0f0f) | ((v & 0x0f0f0f0f) << 4);
+        v = ((v >> 8) & 0x00ff00ff) | ((v & 0x00ff00ff) << 8);
+        return (v >> 16) | (v << 16);
+    }
+
+    static uint32_t sobol_second_dimension(uint32_t index) {
+        // Generator matrix of primitive polynomial x + 1: direction v_{k+1} = v_k ^ (v_k >> 1).
+        // Shuffled indices use all 32 bits, so the product is looked up a byte at a time.
+        static const auto table = [] {
+            std::array<std::array<uint32_t, 256>, 4> t{};
+            uint32_t v = 1u << 31;
+            for (int bit = 0; bit < 32; bit++, v ^= v >> 1)
+                for (int byte = 0; byte < 256; byte++)
+                    if (byte & (1 << (bit % 8)))
+                        t[bit / 8][byte] ^= v;
+            return t;
+        }();
+        return table[0][index & 0xff] ^ table[1][(index >> 8) & 0xff]
+             ^ table[2][(index >> 16) & 0xff] ^ table[3][index >> 24];
+    }
+
+    static uint32_t laine_karras_permutation(uint32_t x, uint32_t seed) {
+        // Hash in which each bit depends only on lower bits: applied to bit-reversed values it
+        // permutes the digits of each level of the binary tree, which is Owen scrambling.
+        x += seed;
+        x ^= x * 0x6c50b47cu;
+        x ^= x * 0xb82f1e52u;
+        x ^= x * 0xc7afe638u;
+        x ^= x * 0x8d22f6e6u;
+        return x;
+    }
+
+    static uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed) {
+        return reverse_bits(laine_karras_permutation(reverse_bits(x), seed));
+    }
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,148 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// Four-lane kernels behind basic_vec3 when it is built with LART_SIMD. Vectors are stored as
+// four aligned scalars whose last lane is always zero, so every kernel may work on all four
+// lanes and dot products need no masking.
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LART_SSE2
+#include <immintrin.h>
+#endif
+
+// Portable fallback; compilers usually vectorize these loops on their own.
+template <typename T>
+struct scalar_lanes {
+    static void add(const T* a, const T* b, T* out) { for (int i = 0; i < 4; i++) out[i] = a[i] + b[i]; }
+    static void sub(const T* a, const T* b, T* out) { for (int i = 0; i < 4; i++) out[i] = a[i] - b[i]; }
+    static void mul(const T* a, const T* b, T* out) { for (int i = 0; i < 4; i++) out[i] = a[i] * b[i]; }
+    static void scale(const T* a, T t, T* out) { for (int i = 0; i < 4; i++) out[i] = a[i] * t; }
+
+    static T dot(const T* a, const T* b) {
+        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    }
+
+    static void cross(const T* a, const T* b, T* out) {
+        T x = a[1] * b[2] - a[2] * b[1];
+        T y = a[2] * b[0] - a[0] * b[2];
+        T z = a[0] * b[1] - a[1] * b[0];
+        out[0] = x; out[1] = y; out[2] = z; out[3] = 0;
+    }
+};
+
+template <typename T>
+struct simd_lanes : scalar_lanes<T> {};
+
+#ifdef LART_SSE2
+
+template <>
+struct simd_lanes<float> {
+    static void add(const float* a, const float* b, float* out) {
+        _mm_store_ps(out, _mm_add_ps(_mm_load_ps(a), _mm_load_ps(b)));
+    }
+
+    static void sub(const float* a, const float* b, float* out) {
+        _mm_store_ps(out, _mm_sub_ps(_mm_load_ps(a), _mm_load_ps(b)));
+    }
+
+    static void mul(const float* a, const float* b, float* out) {
+        _mm_store_ps(out, _mm_mul_ps(_mm_load_ps(a), _mm_load_ps(b)));
+    }
+
+    static void scale(const float* a, float t, float* out) {
+        _mm_store_ps(out, _mm_mul_ps(_mm_load_ps(a), _mm_set1_ps(t)));
+    }
+
+    static float dot(const float* a, const float* b) {
+        __m128 m = _mm_mul_ps(_mm_load_ps(a), _mm_load_ps(b));
+        __m128 s = _mm_add_ps(m, _mm_movehl_ps(m, m));
+        s = _mm_add_ss(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(1, 1, 1, 1)));
+        return _mm_cvtss_f32(s);
+    }
+
+    static void cross(const float* a, const float* b, float* out) {
+        __m128 va = _mm_load_ps(a);
+        __m128 vb = _mm_load_ps(b);
+        __m128 a_yzx = _mm_shuffle_ps(va, va, _MM_SHUFFLE(3, 0, 2, 1));
+        __m128 b_yzx = _mm_shuffle_ps(vb, vb, _MM_SHUFFLE(3, 0, 2, 1));
+        __m128 c = _mm_sub_ps(_mm_mul_ps(va, b_yzx), _mm_mul_ps(a_yzx, vb));
+        _mm_store_ps(out, _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1)));
+    }
+};
+
+#ifdef __AVX2__
+
+template <>
+struct simd_lanes<double> {
+    static void add(const double* a, const double* b, double* out) {
+        _mm256_store_pd(out, _mm256_add_pd(_mm256_load_pd(a), _mm256_load_pd(b)));
+    }
+
+    static void sub(const double* a, const double* b, double* out) {
+        _mm256_store_pd(out, _mm256_sub_pd(_mm256_load_pd(a), _mm256_load_pd(b)));
+    }
+
+    static void mul(const double* a, const double* b, double* out) {
+        _mm256_store_pd(out, _mm256_mul_pd(_mm256_load_pd(a), _mm256_load_pd(b)));
+    }
+
+    static void scale(const double* a, double t, double* out) {
+        _mm256_store_pd(out, _mm256_mul_pd(_mm256_load_pd(a), _mm256_set1_pd(t)));
+    }
+
+    static double dot(const double* a, const double* b) {
+        __m256d m = _mm256_mul_pd(_mm256_load_pd(a), _mm256_load_pd(b));
+        __m128d s = _mm_add_pd(_mm256_castpd256_pd128(m), _mm256_extractf128_pd(m, 1));
+        s = _mm_add_sd(s, _mm_unpackhi_pd(s, s));
+        return _mm_cvtsd_f64(s);
+    }
+
+    static void cross(const double* a, const double* b, double* out) {
+        __m256d va = _mm256_load_pd(a);
+        __m256d vb = _mm256_load_pd(b);
+        __m256d a_yzx = _mm256_permute4x64_pd(va, _MM_SHUFFLE(3, 0, 2, 1));
+        __m256d b_yzx = _mm256_permute4x64_pd(vb, _MM_SHUFFLE(3, 0, 2, 1));
+        __m256d c = _mm256_sub_pd(_mm256_mul_pd(va, b_yzx), _mm256_mul_pd(a_yzx, vb));
+        _mm256_store_pd(out, _mm256_permute4x64_pd(c, _MM_SHUFFLE(3, 0, 2, 1)));
+    }
+};
+
+#else
+
+// SSE2 only: two 128-bit halves, with the shuffle-heavy cross product left scalar.
+template <>
+struct simd_lanes<double> : scalar_lanes<double> {
+    static void add(const double* a, const double* b, double* out) {
+        _mm_store_pd(out, _mm_add_pd(_mm_load_pd(a), _mm_load_pd(b)));
+        _mm_store_pd(out + 2, _mm_add_pd(_mm_load_pd(a + 2), _mm_load_pd(b + 2)));
+    }
+
+    static void sub(const double* a, const double* b, double* out) {
+        _mm_store_pd(out, _mm_sub_pd(_mm_load_pd(a), _mm_load_pd(b)));
+        _mm_store_pd(out + 2, _mm_sub_pd(_mm_load_pd(a + 2), _mm_load_pd(b + 2)));
+    }
+
+    static void mul(const double* a, const double* b, double* out) {
+        _mm_store_pd(out, _mm_mul_pd(_mm_load_pd(a), _mm_load_pd(b)));
+        _mm_store_pd(out + 2, _mm_mul_pd(_mm_load_pd(a + 2), _mm_load_pd(b + 2)));
+    }
+
+    static void scale(const double* a, double t, double* out) {
+        __m128d vt = _mm_set1_pd(t);
+        _mm_store_pd(out, _mm_mul_pd(_mm_load_pd(a), vt));
+        _mm_store_pd(out + 2, _mm_mul_pd(_mm_load_pd(a + 2), vt));
+    }
+
+    static double dot(const double* a, const double* b) {
+        __m128d s = _mm_add_pd(_mm_mul_pd(_mm_load_pd(a), _mm_load_pd(b)),
+                               _mm_mul_pd(_mm_load_pd(a + 2), _mm_load_pd(b + 2)));
+        s = _mm_add_sd(s, _mm_unpackhi_pd(s, s));
+        return _mm_cvtsd_f64(s);
+    }
+};
+
+#endif // __AVX2__
+
+#endif // LART_SSE2
+
+#endif
\ No newline at end of file
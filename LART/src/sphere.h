@@ -5,8 +5,8 @@
 
 class sphere : public hittable {
     public:
-        sphere(const point3& static_center, double radius, shared_ptr<material> mat)
-            : center(static_center), radius(std::fmax(0, radius)), mat(mat) {
+        sphere(const point3& static_center, real radius, shared_ptr<material> mat)
+            : center(static_center), radius(std::fmax(real(0), radius)), mat(mat) {
             auto rvec = vec3(radius, radius, radius);
             bbox = aabb(static_center - rvec, static_center + rvec);
         }
@@ -32,19 +32,23 @@ class sphere : public hittable {
             }
 
             rec.t = root;
+            rec.object = this;
+
+            return true;
+        }
+
+        void set_hit_attributes(const ray& r, hit_record& rec) const override {
             rec.p = r.at(rec.t);
             vec3 outward_normal = (rec.p - center) / radius;
             rec.set_face_normal(r, outward_normal);
-            rec.mat = mat;
-
-            return true;
+            rec.mat = mat.get();
         }
 
         aabb bounding_box() const override { return bbox; }
 
     private:
         point3 center;
-        double radius;
+        real radius;
         shared_ptr<material> mat;
         aabb bbox;
 };
@@ -3,6 +3,7 @@
 
 #include "hittable.h"
 #include "hittable_list.h"
+#include "material.h"
 
 class triangle : public hittable {
   public:
@@ -11,7 +12,9 @@ class triangle : public hittable {
     {
         E1 = v1 - v0;
         E2 = v2 - v0;
-        normal = unit_vector(cross(E1, E2));
+        auto n = cross(E1, E2);
+        normal = unit_vector(n);
+        area = n.length() / 2;
         bbox = aabb(v0, v1, v2);
     }
 
@@ -19,12 +22,12 @@ class triangle : public hittable {
 
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
         auto P = cross(r.direction(), E2);
-        double det = dot(E1, P);
+        real det = dot(E1, P);
 
         if (std::fabs(det) < 1e-8)
             return false;
 
-        double invDet = 1.0 / det;
+        real invDet = 1 / det;
         auto T = r.origin() - v0;
         
         auto u = dot(T, P) * invDet;
@@ -41,18 +44,62 @@ class triangle : public hittable {
         if (!ray_t.contains(t))
             return false;
 
-        // Ray hits the 2D shape; set the rest of the hit record and return true.
+        // Ray hits the triangle; keep the barycentrics and defer the rest of the hit record.
         rec.t = t;
-        rec.p = r.at(t);
-        rec.mat = mat;
-        rec.set_face_normal(r, normal);
+        rec.u = u;
+        rec.v = v;
+        rec.object = this;
 
         return true;
     }
+
+    void set_hit_attributes(const ray& r, hit_record& rec) const override {
+        rec.p = r.at(rec.t);
+        rec.mat = mat.get();
+        rec.set_face_normal(r, normal);
+    }
+
+    void collect_lights(std::vector<const hittable*>& lights) const override {
+        if (mat->kind == material_kind::diffuse_light)
+            lights.push_back(this);
+    }
+
+    double pdf_value(const point3& origin, const vec3& direction) const override {
+        hit_record rec;
+        if (!this->hit(ray(origin, direction), interval(0.001, infinity), rec))
+            return 0;
+
+        auto distance_squared = rec.t * rec.t * direction.length_squared();
+        auto cosine = std::fabs(dot(direction, normal) / direction.length());
+
+        return distance_squared / (cosine * area);
+    }
+
+    vec3 random(const point3& origin, const vec3& u) const override {
+        // Uniform point on the triangle: fold the unit square sample back into it.
+        auto a = u.x();
+        auto b = u.y();
+        if (a + b > 1) {
+            a = 1 - a;
+            b = 1 - b;
+        }
+        return v0 + a * E1 + b * E2 - origin;
+    }
+
+    double emitted_power() const override {
+        auto L = emitted_radiance();
+        return 2 * pi * area * (L.x() + L.y() + L.z()) / 3;
+    }
+
+    vec3 emitting_normal() const override { return normal; }
+
+    color emitted_radiance() const override { return mat->emitted(1.0 / 3, 1.0 / 3, v0 + (E1 + E2) / 3); }
+
   private:
     point3 v0, v1, v2;
     vec3 E1, E2;
     point3 normal;
+    real area;
     shared_ptr<material> mat;
     aabb bbox;
 };
@@ -1,109 +1,210 @@
 #ifndef VEC3_H
 #define VEC3_H
 
-class vec3 {
+#include <type_traits>
+
+#ifdef LART_SIMD
+#include "simd.h"
+#endif
+
+// Vector of three scalars of type T. Geometry uses vec3 (T = real); other precisions can be
+// instantiated where a subsystem needs them, e.g. double pixel sums in a float build.
+//
+// With LART_SIMD the vector is padded to four aligned lanes (the last one always zero) and
+// the arithmetic below runs through the kernels in simd.h.
+template <typename T>
+class basic_vec3 {
   public:
-    double e[3];
+#ifdef LART_SIMD
+    alignas(4 * sizeof(T)) T e[4];
+
+    basic_vec3() : e{ 0, 0, 0, 0 } {}
+    basic_vec3(T e0, T e1, T e2) : e{ e0, e1, e2, 0 } {}
+
+    template <typename U>
+    explicit basic_vec3(const basic_vec3<U>& v) : e{ T(v.e[0]), T(v.e[1]), T(v.e[2]), 0 } {}
+#else
+    T e[3];
+
+    basic_vec3() : e{ 0, 0, 0 } {}
+    basic_vec3(T e0, T e1, T e2) : e{ e0, e1, e2 } {}
 
-    vec3() : e{ 0, 0, 0 } {}
-    vec3(double e0, double e1, double e2) : e{ e0, e1, e2 } {}
+    template <typename U>
+    explicit basic_vec3(const basic_vec3<U>& v) : e{ T(v.e[0]), T(v.e[1]), T(v.e[2]) } {}
+#endif
 
-    double x() const { return e[0]; }
-    double y() const { return e[1]; }
-    double z() const { return e[2]; }
+    T x() const { return e[0]; }
+    T y() const { return e[1]; }
+    T z() const { return e[2]; }
 
-    vec3 operator-() const { return vec3(-e[0], -e[1], -e[2]); }
-    double operator[](int i) const { return e[i]; }
-    double& operator[](int i) { return e[i]; }
+    basic_vec3 operator-() const { return basic_vec3(-e[0], -e[1], -e[2]); }
+    T operator[](int i) const { return e[i]; }
+    T& operator[](int i) { return e[i]; }
 
-    vec3& operator+=(const vec3& v) {
+    basic_vec3& operator+=(const basic_vec3& v) {
+#ifdef LART_SIMD
+        simd_lanes<T>::add(e, v.e, e);
+#else
         e[0] += v.e[0];
         e[1] += v.e[1];
         e[2] += v.e[2];
+#endif
         return *this;
     }
 
-    vec3& operator*=(double t) {
+    basic_vec3& operator*=(T t) {
+#ifdef LART_SIMD
+        simd_lanes<T>::scale(e, t, e);
+#else
         e[0] *= t;
         e[1] *= t;
         e[2] *= t;
+#endif
         return *this;
     }
 
-    vec3& operator/=(double t) {
+    basic_vec3& operator/=(T t) {
         return *this *= 1 / t;
     }
 
-    double length() const {
+    T length() const {
         return std::sqrt(length_squared());
     }
 
-    double length_squared() const {
+    T length_squared() const {
+#ifdef LART_SIMD
+        return simd_lanes<T>::dot(e, e);
+#else
         return e[0] * e[0] + e[1] * e[1] + e[2] * e[2];
+#endif
     }
 
     bool near_zero() const {
         // Return true if the vector is close to zero in all dimensions.
-        auto s = 1e-8;
+        auto s = T(1e-8);
         return (std::fabs(e[0]) < s) && (std::fabs(e[1]) < s) && (std::fabs(e[2]) < s);
     }
 
-    static vec3 random() {
-        return vec3(random_double(), random_double(), random_double());
+    static basic_vec3 random() {
+        return basic_vec3(random_double(), random_double(), random_double());
     }
 
-    static vec3 random(double min, double max) {
-        return vec3(random_double(min, max), random_double(min, max), random_double(min, max));
+    static basic_vec3 random(double min, double max) {
+        return basic_vec3(random_double(min, max), random_double(min, max), random_double(min, max));
     }
 };
 
+using vec3 = basic_vec3<real>;
+
 // point3 is just an alias for vec3, but useful for geometric clarity in the code.
 using point3 = vec3;
 
 
 // Vector Utility Functions
+//
+// Scalar arguments use std::type_identity_t so that the vector alone decides T, and literals
+// such as `2 * v` work for every precision.
+
+template <typename T>
+using scalar_of = std::type_identity_t<T>;
 
-inline std::ostream& operator<<(std::ostream& out, const vec3& v) {
+template <typename T>
+inline std::ostream& operator<<(std::ostream& out, const basic_vec3<T>& v) {
     return out << v.e[0] << ' ' << v.e[1] << ' ' << v.e[2];
 }
 
-inline vec3 operator+(const vec3& u, const vec3& v) {
-    return vec3(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
+#ifdef LART_SIMD
+
+template <typename T>
+inline basic_vec3<T> operator+(const basic_vec3<T>& u, const basic_vec3<T>& v) {
+    basic_vec3<T> r;
+    simd_lanes<T>::add(u.e, v.e, r.e);
+    return r;
 }
 
-inline vec3 operator-(const vec3& u, const vec3& v) {
-    return vec3(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
+template <typename T>
+inline basic_vec3<T> operator-(const basic_vec3<T>& u, const basic_vec3<T>& v) {
+    basic_vec3<T> r;
+    simd_lanes<T>::sub(u.e, v.e, r.e);
+    return r;
 }
 
-inline vec3 operator*(const vec3& u, const vec3& v) {
-    return vec3(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
+template <typename T>
+inline basic_vec3<T> operator*(const basic_vec3<T>& u, const basic_vec3<T>& v) {
+    basic_vec3<T> r;
+    simd_lanes<T>::mul(u.e, v.e, r.e);
+    return r;
 }
 
-inline vec3 operator*(double t, const vec3& v) {
-    return vec3(t * v.e[0], t * v.e[1], t * v.e[2]);
+template <typename T>
+inline basic_vec3<T> operator*(scalar_of<T> t, const basic_vec3<T>& v) {
+    basic_vec3<T> r;
+    simd_lanes<T>::scale(v.e, t, r.e);
+    return r;
 }
 
-inline vec3 operator*(const vec3& v, double t) {
-    return t * v;
+template <typename T>
+inline T dot(const basic_vec3<T>& u, const basic_vec3<T>& v) {
+    return simd_lanes<T>::dot(u.e, v.e);
 }
 
-inline vec3 operator/(const vec3& v, double t) {
-    return (1 / t) * v;
+template <typename T>
+inline basic_vec3<T> cross(const basic_vec3<T>& u, const basic_vec3<T>& v) {
+    basic_vec3<T> r;
+    simd_lanes<T>::cross(u.e, v.e, r.e);
+    return r;
+}
+
+#else
+
+template <typename T>
+inline basic_vec3<T> operator+(const basic_vec3<T>& u, const basic_vec3<T>& v) {
+    return basic_vec3<T>(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
+}
+
+template <typename T>
+inline basic_vec3<T> operator-(const basic_vec3<T>& u, const basic_vec3<T>& v) {
+    return basic_vec3<T>(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
+}
+
+template <typename T>
+inline basic_vec3<T> operator*(const basic_vec3<T>& u, const basic_vec3<T>& v) {
+    return basic_vec3<T>(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
 }
 
-inline double dot(const vec3& u, const vec3& v) {
+template <typename T>
+inline basic_vec3<T> operator*(scalar_of<T> t, const basic_vec3<T>& v) {
+    return basic_vec3<T>(t * v.e[0], t * v.e[1], t * v.e[2]);
+}
+
+template <typename T>
+inline T dot(const basic_vec3<T>& u, const basic_vec3<T>& v) {
     return u.e[0] * v.e[0]
          + u.e[1] * v.e[1]
          + u.e[2] * v.e[2];
 }
 
-inline vec3 cross(const vec3& u, const vec3& v) {
-    return vec3(u.e[1] * v.e[2] - u.e[2] * v.e[1],
-                u.e[2] * v.e[0] - u.e[0] * v.e[2],
-                u.e[0] * v.e[1] - u.e[1] * v.e[0]);
+template <typename T>
+inline basic_vec3<T> cross(const basic_vec3<T>& u, const basic_vec3<T>& v) {
+    return basic_vec3<T>(u.e[1] * v.e[2] - u.e[2] * v.e[1],
+                         u.e[2] * v.e[0] - u.e[0] * v.e[2],
+                         u.e[0] * v.e[1] - u.e[1] * v.e[0]);
+}
+
+#endif
+
+template <typename T>
+inline basic_vec3<T> operator*(const basic_vec3<T>& v, scalar_of<T> t) {
+    return t * v;
+}
+
+template <typename T>
+inline basic_vec3<T> operator/(const basic_vec3<T>& v, scalar_of<T> t) {
+    return (1 / t) * v;
 }
 
-inline vec3 unit_vector(const vec3& v) {
+template <typename T>
+inline basic_vec3<T> unit_vector(const basic_vec3<T>& v) {
     return v / v.length();
 }
 
@@ -117,13 +218,42 @@ inline vec3 random_in_unit_disk() {
 
 inline vec3 random_unit_vector() {
     while (true) {
-        auto p = vec3::random(-1, 1);
+        auto p = basic_vec3<double>::random(-1, 1);
         auto lensq = p.length_squared();
         if (1e-160 < lensq && lensq <= 1)
-            return p / sqrt(lensq);
+            return vec3(p / sqrt(lensq));
     }
 }
 
+// Warps of a 2D sample u = (u1, u2, 0) in [0,1)^2, for sampler-driven versions of the above.
+
+inline vec3 sample_unit_disk(const vec3& u) {
+    // Concentric map of the square onto the disk (Shirley and Chiu), which keeps strata compact.
+    auto a = 2 * u.x() - 1;
+    auto b = 2 * u.y() - 1;
+    if (a == 0 && b == 0)
+        return vec3(0, 0, 0);
+
+    double r, theta;
+    if (std::fabs(a) > std::fabs(b)) {
+        r = a;
+        theta = (pi / 4) * (b / a);
+    }
+    else {
+        r = b;
+        theta = pi / 2 - (pi / 4) * (a / b);
+    }
+    return vec3(r * std::cos(theta), r * std::sin(theta), 0);
+}
+
+inline vec3 sample_unit_vector(const vec3& u) {
+    // Uniform on the unit sphere: z uniform in [-1,1], azimuth uniform.
+    auto z = 1 - 2 * double(u.x());
+    auto r = std::sqrt(std::fmax(0.0, 1 - z * z));
+    auto phi = 2 * pi * u.y();
+    return vec3(r * std::cos(phi), r * std::sin(phi), z);
+}
+
 inline vec3 random_on_hemisphere(const vec3& normal) {
     vec3 on_unit_sphere = random_unit_vector();
     if (dot(on_unit_sphere, normal) > 0.0) // In the same hemisphere as the normal
@@ -132,14 +262,16 @@ inline vec3 random_on_hemisphere(const vec3& normal) {
         return -on_unit_sphere;
 }
 
-inline vec3 reflect(const vec3& v, const vec3& n) {
+template <typename T>
+inline basic_vec3<T> reflect(const basic_vec3<T>& v, const basic_vec3<T>& n) {
     return v - 2 * dot(v, n) * n;
 }
 
-inline vec3 refract(const vec3& uv, const vec3& n, double etai_over_etat) {
-    auto cos_theta = std::fmin(dot(-uv, n), 1.0);
-    vec3 r_out_perp = etai_over_etat * (uv + cos_theta * n);
-    vec3 r_out_parallel = -std::sqrt(std::fabs(1.0 - r_out_perp.length_squared())) * n;
+template <typename T>
+inline basic_vec3<T> refract(const basic_vec3<T>& uv, const basic_vec3<T>& n, scalar_of<T> etai_over_etat) {
+    auto cos_theta = std::fmin(dot(-uv, n), T(1));
+    basic_vec3<T> r_out_perp = etai_over_etat * (uv + cos_theta * n);
+    basic_vec3<T> r_out_parallel = -std::sqrt(std::fabs(1 - r_out_perp.length_squared())) * n;
     return r_out_perp + r_out_parallel;
 }
 